@@ -12,6 +12,19 @@
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <utility>
+#include <iterator>
+#include <new>
+
+#include "simd.h"
+#include "format.h"
+#include "memory.h"
+
+#if __cplusplus >= 201103L
+#define FRAMEWORK_CXX11
+#include <initializer_list>
+#endif
 
 namespace framework
 {
@@ -25,7 +38,10 @@ namespace framework
             NOT_ELEMENT,
             DIM_ERROR,
             OUT_OF_RANGE,
-            NOT_ALLOCATED
+            NOT_ALLOCATED,
+            IO_ERROR,
+            SINGULAR,
+            NOT_DEFINITE
         } code_;
 
         array_exception(category code) : code_(code) {}
@@ -51,42 +67,301 @@ namespace framework
                     return "out of range";
                 case NOT_ALLOCATED:
                     return "the object is not allocated yet";
+                case IO_ERROR:
+                    return "input/output error";
+                case SINGULAR:
+                    return "the matrix is singular";
+                case NOT_DEFINITE:
+                    return "the matrix is not positive definite";
                 default:
                     return "unknown error";
             }
         }
     }; // struct array_exception
 
+    template <typename E> class expr;
+
+    // storage of every array is aligned to a cache line
+    enum { ARRAY_ALIGNMENT = 64 };
+
+    template <typename T>
+    inline T* aligned_new(size_t n)
+    {
+        void* raw = ::operator new(n * sizeof(T) + sizeof(void*) + ARRAY_ALIGNMENT);
+        size_t addr = reinterpret_cast<size_t>(raw) + sizeof(void*);
+        addr = (addr + ARRAY_ALIGNMENT - 1) & ~static_cast<size_t>(ARRAY_ALIGNMENT - 1);
+        T* p = reinterpret_cast<T*>(addr);
+        reinterpret_cast<void**>(p)[-1] = raw;
+        size_t i = 0;
+        try {
+            for (; i < n; i++)
+                new (p + i) T;
+        } catch (...) {
+            while (i) p[--i].~T();
+            ::operator delete(raw);
+            throw;
+        }
+        return p;
+    }
+
+    template <typename T>
+    inline void aligned_delete(T* p, size_t n)
+    {
+        if (!p) return;
+        while (n) p[--n].~T();
+        ::operator delete(reinterpret_cast<void**>(p)[-1]);
+    }
+
+    // the same on a memory resource, which is told the size back
+    template <typename T>
+    inline T* aligned_new(size_t n, memory_resource* mr)
+    {
+        T* p = static_cast<T*>(mr->allocate(n * sizeof(T), ARRAY_ALIGNMENT));
+        size_t i = 0;
+        try {
+            for (; i < n; i++)
+                new (p + i) T;
+        } catch (...) {
+            while (i) p[--i].~T();
+            mr->deallocate(p, n * sizeof(T), ARRAY_ALIGNMENT);
+            throw;
+        }
+        return p;
+    }
+
+    template <typename T>
+    inline void aligned_delete(T* p, size_t n, memory_resource* mr)
+    {
+        if (!p) return;
+        for (size_t i = n; i; ) p[--i].~T();
+        mr->deallocate(p, n * sizeof(T), ARRAY_ALIGNMENT);
+    }
+
+    // access policies for array_ref. checked_access keeps the diagnostics
+    // of array::operator[], unchecked_access compiles them away.
+    struct checked_access
+    {
+        static inline void check(size_t idx, size_t sz, const void* p)
+        {
+            if (idx >= sz)
+                throw(array_exception(array_exception::OUT_OF_RANGE));
+            if (!p)
+                throw(array_exception(array_exception::NOT_ALLOCATED));
+        }
+    }; // struct checked_access
+
+    struct unchecked_access
+    {
+        static inline void check(size_t, size_t, const void*) {}
+    }; // struct unchecked_access
+
+#ifdef NDEBUG
+    typedef unchecked_access    default_access;
+#else
+    typedef checked_access      default_access;
+#endif
+
+    // non-virtual reference to the elements of an array. it doesn't own
+    // the storage and is invalidated by resizing or clearing the array.
+    template <typename T, size_t dim, typename Access = default_access>
+    class array_ref
+    {
+        template <typename U, size_t d, typename A> friend class array_ref;
+
+        protected:
+            T*      data_;
+            size_t  ext_[dim];
+            size_t  stride_[dim];
+
+        public:
+            array_ref() : data_(NULL)
+            {
+                for (size_t k = 0; k < dim; k++)
+                    ext_[k] = stride_[k] = 0;
+            }
+
+            array_ref(T* data, const size_t* ext, const size_t* stride)
+                : data_(data)
+            {
+                for (size_t k = 0; k < dim; k++) {
+                    ext_[k]    = ext[k];
+                    stride_[k] = stride[k];
+                }
+            }
+
+            template <typename U, typename A>
+            array_ref(const array_ref<U, dim, A>& other) : data_(other.data_)
+            {
+                for (size_t k = 0; k < dim; k++) {
+                    ext_[k]    = other.ext_[k];
+                    stride_[k] = other.stride_[k];
+                }
+            }
+
+            inline array_ref<T, dim-1, Access> operator[] (size_t idx) const
+            {
+                Access::check(idx, ext_[0], data_);
+                return array_ref<T, dim-1, Access>(data_ + idx * stride_[0],
+                                                   ext_ + 1, stride_ + 1);
+            }
+
+            inline array_ref<T, dim-1, Access> at(size_t idx) const
+            {
+                return operator[](idx);
+            }
+
+            inline size_t size(const size_t o = 0, const size_t d = dim) const
+            {
+                size_t k = dim - (d - o);
+                return ext_[(k < dim) ? k : dim - 1];
+            }
+
+            inline size_t stride(const size_t k = 0) const
+            {
+                return stride_[k];
+            }
+
+            inline T* data(void) const
+            {
+                return data_;
+            }
+
+    }; // class array_ref<T, dim, Access>
+
+    template <typename T, typename Access>
+    class array_ref<T, 1, Access>
+    {
+        template <typename U, size_t d, typename A> friend class array_ref;
+
+        protected:
+            T*      data_;
+            size_t  ext_[1];
+            size_t  stride_[1];
+
+        public:
+            array_ref() : data_(NULL)
+            {
+                ext_[0] = stride_[0] = 0;
+            }
+
+            array_ref(T* data, const size_t* ext, const size_t* stride)
+                : data_(data)
+            {
+                ext_[0]    = ext[0];
+                stride_[0] = stride[0];
+            }
+
+            template <typename U, typename A>
+            array_ref(const array_ref<U, 1, A>& other) : data_(other.data_)
+            {
+                ext_[0]    = other.ext_[0];
+                stride_[0] = other.stride_[0];
+            }
+
+            inline T& operator[] (size_t idx) const
+            {
+                Access::check(idx, ext_[0], data_);
+                return data_[idx * stride_[0]];
+            }
+
+            inline T& at(size_t idx) const
+            {
+                return operator[](idx);
+            }
+
+            inline size_t size(const size_t o = 0, const size_t d = 1) const
+            {
+                return ext_[0];
+            }
+
+            inline size_t stride(const size_t k = 0) const
+            {
+                return stride_[0];
+            }
+
+            inline T* data(void) const
+            {
+                return data_;
+            }
+
+    }; // class array_ref<T, 1, Access>
+
+    // multi-dimensional arrays keep all elements in one contiguous block
+    // owned by the outermost array. the sub-arrays returned by operator[]
+    // are headers bound into that block, so they can't be resized alone.
     template <typename T, size_t dim>
     class array
     {
+        template <typename U, size_t d> friend class array;
+
         protected:
             array<T, dim-1>*    container_;
             size_t              sz_;
             size_t              tpos_;
+            T*                  data_;      // first element of the block
+            size_t              stride_;    // elements per sub-array
+            array<T, 1>*        rows_;      // row headers of a 3-d array
+            bool                own_;       // false if bound into a block
+            bool                borrowed_;  // the block isn't allocated here
+            size_t              cap_;       // elements allocated in the block
+            size_t              hcap_;      // headers allocated in container_
+            size_t              rcap_;      // headers allocated in rows_
+            memory_resource*    mem_;       // source of the block and headers
 
         public:
-            array() : container_(NULL), sz_(0), tpos_(0)
+            typedef T           value_type;
+            typedef T*          iterator;
+            typedef const T*    const_iterator;
+
+            array()
             {
                 if ((dim < 1) || (dim > 3))
                     throw(array_exception(array_exception::DIM_ERROR));
+                init_();
+            }
+
+            array(const array<T, dim>& other)
+            {
+                init_();
+                operator= (other);
             }
 
-            array(array<T, dim>& other) : container_(NULL), sz_(0)
+            template <typename T2>
+            array(const array<T2, dim>& other)
             {
+                init_();
                 operator= (other);
             }
 
+            template <typename E>
+            array(const expr<E>& e)
+            {
+                init_();
+                operator= (e);
+            }
+
             array(size_t s1, size_t s2)
             {
+                init_();
                 set_size(s1, s2);
             }
 
             array(size_t s1, size_t s2, size_t s3)
             {
+                init_();
                 set_size(s1, s2, s3);
             }
 
+#ifdef FRAMEWORK_CXX11
+            // a bound sub-array can't give its storage away and is copied,
+            // which may allocate and throw, hence no noexcept
+            array(array<T, dim>&& other)
+            {
+                init_();
+                operator= (std::move(other));
+            }
+#endif
+
             virtual ~array()
             {
                 clear();
@@ -96,31 +371,56 @@ namespace framework
             {
                 if (dim != 2)
                     throw(array_exception(array_exception::DIM_ERROR));
-                container_ = new array<T, dim-1> [s1];
-                sz_        = s1;
-                tpos_      = 0;
-                for (size_t i = 0; i < s1; i++)
-                    container_[i].set_size(s2);
+                size_t ext[] = { s1, s2 };
+                alloc_(ext);
             }
 
             inline void set_size(size_t s1, size_t s2, size_t s3)
             {
                 if (dim != 3)
                     throw(array_exception(array_exception::DIM_ERROR));
-                container_ = new array<T, dim-1> [s1];
-                sz_        = s1;
-                tpos_      = 0;
-                for (size_t i = 0; i < s1; i++)
-                    container_[i].set_size(s2, s3);
+                size_t ext[] = { s1, s2, s3 };
+                alloc_(ext);
             }
 
             inline virtual void clear()
             {
-                if (!container_) return;
-                delete [] container_;
-                container_ = NULL;
-                sz_        = 0;
-                tpos_      = 0;
+                if (!own_) return;
+                aligned_delete(container_, hcap_, mem_);
+                aligned_delete(rows_, rcap_, mem_);
+                if (!borrowed_)
+                    aligned_delete(data_, cap_, mem_);
+                reset_();
+            }
+
+            inline void swap(array<T, dim>& other)
+            {
+                if (!own_ || !other.own_ || borrowed_ || other.borrowed_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                std::swap(container_, other.container_);
+                std::swap(sz_,        other.sz_);
+                std::swap(tpos_,      other.tpos_);
+                std::swap(data_,      other.data_);
+                std::swap(stride_,    other.stride_);
+                std::swap(rows_,      other.rows_);
+                std::swap(cap_,       other.cap_);
+                std::swap(hcap_,      other.hcap_);
+                std::swap(rcap_,      other.rcap_);
+                std::swap(mem_,       other.mem_);
+            }
+
+            // storage comes from mr from now on, the elements are dropped
+            inline void set_resource(memory_resource* mr)
+            {
+                if (!own_ || borrowed_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                clear();
+                mem_ = mr ? mr : default_resource();
+            }
+
+            inline memory_resource* resource(void) const
+            {
+                return mem_;
             }
 
             inline void resize(size_t s1, size_t s2)
@@ -144,11 +444,25 @@ namespace framework
                 return container_[idx];
             }
 
+            inline virtual const array<T, dim-1>& operator[] (size_t idx) const
+            {
+                if (idx >= sz_)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                if (!container_)
+                    throw(array_exception(array_exception::NOT_ALLOCATED));
+                return container_[idx];
+            }
+
             inline virtual array<T, dim-1>& at(size_t idx)
             {
                 return operator[](idx);
             }
 
+            inline virtual const array<T, dim-1>& at(size_t idx) const
+            {
+                return operator[](idx);
+            }
+
             inline bool push(const T e)
             {
                 if (tpos_ >= sz_) 
@@ -172,10 +486,73 @@ namespace framework
             {
                 if (dim == (d - o))
                     return sz_;
+                else if (!sz_)
+                    return 0;
                 else
                     return container_[0].size(o, d);
             }
 
+            inline size_t pos(void) const
+            {
+                return tpos_;
+            }
+
+            inline size_t count(void) const
+            {
+                return sz_ * stride_;
+            }
+
+            inline T* data(void)
+            {
+                return data_;
+            }
+
+            inline const T* data(void) const
+            {
+                return data_;
+            }
+
+            // every element in row-major order
+            inline iterator begin(void)
+            {
+                return data_;
+            }
+
+            inline iterator end(void)
+            {
+                return data_ + count();
+            }
+
+            inline const_iterator begin(void) const
+            {
+                return data_;
+            }
+
+            inline const_iterator end(void) const
+            {
+                return data_ + count();
+            }
+
+            inline array_ref<T, dim> ref(void)
+            {
+                return make_ref_<T, default_access>(data_);
+            }
+
+            inline array_ref<const T, dim> ref(void) const
+            {
+                return make_ref_<const T, default_access>(data_);
+            }
+
+            inline array_ref<T, dim, checked_access> checked(void)
+            {
+                return make_ref_<T, checked_access>(data_);
+            }
+
+            inline array_ref<T, dim, unchecked_access> unchecked(void)
+            {
+                return make_ref_<T, unchecked_access>(data_);
+            }
+
             inline void reset_pos(void)
             {
                 tpos_ = 0;
@@ -183,14 +560,11 @@ namespace framework
                     container_[i].reset_pos();
             }
 
-            inline array<T, dim>& operator= (array<T, dim>& rhs)
+            // reuses the storage when it's large enough for rhs
+            inline array<T, dim>& operator= (const array<T, dim>& rhs)
             {
-                if (sz_ != rhs.sz_)
-                    clear();
-                if (!container_) {
-                    sz_ = rhs.sz_;
-                    container_ = new array<T, dim-1> [sz_];
-                }
+                if (this == &rhs) return *this;
+                reshape_(rhs);
                 tpos_ = rhs.tpos_;
                 for (size_t i = 0; i < sz_; i++)
                     container_[i] = rhs.container_[i];
@@ -198,17 +572,45 @@ namespace framework
             }
 
             template <typename T2>
-            inline array<T, dim>& operator= (array<T2, dim>& rhs)
+            inline array<T, dim>& operator= (const array<T2, dim>& rhs)
             {
-                if (sz_ != rhs.size())
-                    clear();
-                if (!container_) {
-                    sz_ = rhs.size();
-                    container_ = new array<T, dim-1> [sz_];
-                }
-                tpos_ = rhs.pos();
+                reshape_(rhs);
+                tpos_ = rhs.tpos_;
                 for (size_t i = 0; i < sz_; i++)
-                    container_[i] = rhs[i];
+                    container_[i] = rhs.container_[i];
+                return *this;
+            }
+
+#ifdef FRAMEWORK_CXX11
+            // copies when either side's storage can't change hands, which
+            // may throw
+            inline array<T, dim>& operator= (array<T, dim>&& rhs)
+            {
+                if (this == &rhs) return *this;
+                if (!own_ || !rhs.own_ || borrowed_ || rhs.borrowed_)
+                    return operator= (static_cast<const array<T, dim>&>(rhs));
+                clear();
+                swap(rhs);
+                return *this;
+            }
+#endif
+
+            // evaluates an expression of expression.h in a single pass
+            template <typename E>
+            inline array<T, dim>& operator= (const expr<E>& e)
+            {
+                if ((size_t)E::dimension != dim)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t ext[dim];
+                bool same = true;
+                for (size_t k = 0; k < dim; k++) {
+                    ext[k] = e.size(k);
+                    if (ext[k] != size(k)) same = false;
+                }
+                if (!same) alloc_(ext);
+                T* p = data_;
+                for (size_t i = 0, n = count(); i < n; i++)
+                    p[i] = static_cast<T>(e[i]);
                 return *this;
             }
 
@@ -233,35 +635,263 @@ namespace framework
                 return *this;
             }
 
+            // loads the elements in row-major order from the start, like
+            // pushing each of them but with one size check for the range.
+            // the position is left after the last one.
+            template <typename It>
+            inline void assign(It first, It last)
+            {
+                load_(first, last, typename std::iterator_traits<It>::iterator_category());
+            }
+
+            // a single copy, memcpy for the trivially copyable types
+            template <typename T2>
+            inline void assign(T2* first, T2* last)
+            {
+                size_t n = static_cast<size_t>(last - first);
+                if (n > count())
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                simd::convert(data_, first, n);
+                seek_(n);
+            }
+
+#ifdef FRAMEWORK_CXX11
+            inline void assign(std::initializer_list<T> l)
+            {
+                assign(l.begin(), l.end());
+            }
+
+            inline array<T, dim>& operator= (std::initializer_list<T> l)
+            {
+                assign(l.begin(), l.end());
+                return *this;
+            }
+#endif
+
+        protected:
+            inline void init_(void)
+            {
+                mem_ = default_resource();
+                reset_();
+            }
+
+            // the positions n pushes from the start would leave
+            inline void seek_(size_t n)
+            {
+                tpos_ = stride_ ? n / stride_ : 0;
+                for (size_t i = 0, b = 0; i < sz_; i++, b += stride_)
+                    container_[i].seek_((n <= b) ? 0 : std::min(n - b, stride_));
+            }
+
+            template <typename It>
+            inline void load_(It first, It last, std::forward_iterator_tag)
+            {
+                size_t n = static_cast<size_t>(std::distance(first, last));
+                if (n > count())
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                for (T* p = data_; first != last; ++first)
+                    *p++ = static_cast<T>(*first);
+                seek_(n);
+            }
+
+            // the length isn't known in advance, checked as it goes
+            template <typename It>
+            inline void load_(It first, It last, std::input_iterator_tag)
+            {
+                size_t n = 0;
+                for (size_t c = count(); first != last; ++first, ++n) {
+                    if (n == c) {
+                        seek_(n);
+                        throw(array_exception(array_exception::OUT_OF_RANGE));
+                    }
+                    data_[n] = static_cast<T>(*first);
+                }
+                seek_(n);
+            }
+
+            inline void reset_(void)
+            {
+                container_ = NULL;
+                sz_        = 0;
+                tpos_      = 0;
+                data_      = NULL;
+                stride_    = 0;
+                rows_      = NULL;
+                own_       = true;
+                borrowed_  = false;
+                cap_       = 0;
+                hcap_      = 0;
+                rcap_      = 0;
+            }
+
+            // allocates the block and the headers of every level at once,
+            // or just rebinds the headers if the current ones are enough
+            inline void alloc_(const size_t* ext)
+            {
+                if (!own_ || borrowed_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t n     = extent_(ext);
+                size_t nrows = (dim > 2) ? ext[0] * ext[1] : 0;
+                if (!container_ || (n > cap_) || (ext[0] > hcap_) || (nrows > rcap_)) {
+                    clear();
+                    data_ = aligned_new<T>(n, mem_);
+                    cap_  = n;
+                    headers_(ext);
+                }
+                link_(ext);
+            }
+
+            // binds the headers to a block owned by someone else, e.g. a
+            // file mapping. the shape of such an array can't be changed.
+            inline void attach_(T* data, const size_t* ext)
+            {
+                if (!own_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                array<T, dim>::clear();
+                data_     = data;
+                cap_      = extent_(ext);
+                borrowed_ = true;
+                headers_(ext);
+                link_(ext);
+            }
+
+            inline size_t extent_(const size_t* ext) const
+            {
+                size_t n = 1;
+                for (size_t k = 0; k < dim; k++)
+                    n *= ext[k];
+                return n;
+            }
+
+            inline void headers_(const size_t* ext)
+            {
+                size_t nrows = (dim > 2) ? ext[0] * ext[1] : 0;
+                container_ = aligned_new<array<T, dim-1> >(ext[0], mem_);
+                hcap_      = ext[0];
+                rows_      = nrows ? aligned_new<array<T, 1> >(nrows, mem_) : NULL;
+                rcap_      = nrows;
+            }
+
+            inline void link_(const size_t* ext)
+            {
+                sz_     = ext[0];
+                stride_ = 1;
+                tpos_   = 0;
+                for (size_t k = 1; k < dim; k++)
+                    stride_ *= ext[k];
+                for (size_t i = 0; i < sz_; i++)
+                    container_[i].bind_(data_ + i * stride_, ext + 1,
+                                        rows_ ? rows_ + i * ext[1] : NULL);
+            }
+
+            // makes this array a header of a sub-block owned by its parent
+            inline void bind_(T* data, const size_t* ext, array<T, 1>* rows)
+            {
+                container_ = rows;
+                own_       = false;
+                sz_        = ext[0];
+                stride_    = ext[1];
+                data_      = data;
+                tpos_      = 0;
+                for (size_t i = 0; i < sz_; i++)
+                    container_[i].bind_(data + i * stride_, ext + 1, NULL);
+            }
+
+            template <typename U, typename Access>
+            inline array_ref<U, dim, Access> make_ref_(U* data) const
+            {
+                size_t ext[dim], stride[dim];
+                for (size_t k = 0; k < dim; k++)
+                    ext[k] = size(k);
+                stride[dim-1] = 1;
+                for (size_t k = dim-1; k > 0; k--)
+                    stride[k-1] = stride[k] * ext[k];
+                return array_ref<U, dim, Access>(data, ext, stride);
+            }
+
+            template <typename T2>
+            inline void reshape_(const array<T2, dim>& rhs)
+            {
+                size_t ext[dim];
+                bool same = true;
+                for (size_t k = 0; k < dim; k++) {
+                    ext[k] = rhs.size(k);
+                    if (ext[k] != size(k)) same = false;
+                }
+                if (!same) alloc_(ext);
+            }
+
     }; // class array<T, dim>
 
     template<typename T>
     class array<T, 1>
     {
+        template <typename U, size_t d> friend class array;
+
         protected:
             T*      element_;
             size_t  sz_;
             size_t  tpos_;
+            bool    own_;       // false if bound into a block
+            bool    borrowed_;  // element_ isn't allocated here
+            size_t  cap_;       // elements allocated in element_
+            memory_resource* mem_;  // source of element_
 
         public:
-            array() : element_(NULL), sz_(0), tpos_(0) {}
+            typedef T           value_type;
+            typedef T*          iterator;
+            typedef const T*    const_iterator;
 
-            array(array<T, 1>& other) : element_(NULL), sz_(0)
+            array()
             {
+                init_();
+            }
+
+            array(const array<T, 1>& other)
+            {
+                init_();
                 operator= (other);
             }
 
             template <typename T2>
-            array(array<T2, 1>& other) : element_(NULL), sz_(0)
+            array(const array<T2, 1>& other)
             {
+                init_();
                 operator= (other);
             }
 
+            template <typename E>
+            array(const expr<E>& e)
+            {
+                init_();
+                operator= (e);
+            }
+
             array(size_t s1)
             {
+                init_();
                 set_size(s1);
             }
 
+#ifdef FRAMEWORK_CXX11
+            array(std::initializer_list<T> l)
+            {
+                init_();
+                set_size(l.size());
+                assign(l.begin(), l.end());
+            }
+#endif
+
+#ifdef FRAMEWORK_CXX11
+            // a bound row can't give its storage away and is copied,
+            // which may allocate and throw, hence no noexcept
+            array(array<T, 1>&& other)
+            {
+                init_();
+                operator= (std::move(other));
+            }
+#endif
+
             virtual ~array()
             {
                 clear();
@@ -269,16 +899,46 @@ namespace framework
 
             inline void set_size(size_t s1)
             {
-                element_ = new T [s1];
+                if (!own_ || borrowed_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                clear();
+                element_ = aligned_new<T>(s1, mem_);
                 sz_      = s1;
+                cap_     = s1;
                 tpos_    = 0;
             }
 
             inline virtual void clear()
             {
-                if (!element_) return;
-                delete [] element_;
-                element_ = NULL;
+                if (!own_) return;
+                if (!borrowed_)
+                    aligned_delete(element_, cap_, mem_);
+                reset_();
+            }
+
+            inline void swap(array<T, 1>& other)
+            {
+                if (!own_ || !other.own_ || borrowed_ || other.borrowed_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                std::swap(element_, other.element_);
+                std::swap(sz_,      other.sz_);
+                std::swap(tpos_,    other.tpos_);
+                std::swap(cap_,     other.cap_);
+                std::swap(mem_,     other.mem_);
+            }
+
+            // storage comes from mr from now on, the elements are dropped
+            inline void set_resource(memory_resource* mr)
+            {
+                if (!own_ || borrowed_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                clear();
+                mem_ = mr ? mr : default_resource();
+            }
+
+            inline memory_resource* resource(void) const
+            {
+                return mem_;
             }
 
             inline void resize(size_t s1)
@@ -296,11 +956,25 @@ namespace framework
                 return element_[idx];
             }
 
+            inline virtual const T& operator[] (size_t idx) const
+            {
+                if (idx >= sz_)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                if (!element_)
+                    throw(array_exception(array_exception::NOT_ALLOCATED));
+                return element_[idx];
+            }
+
             inline T& at(size_t idx)
             {
                 return operator[](idx);
             }
 
+            inline const T& at(size_t idx) const
+            {
+                return operator[](idx);
+            }
+
             inline virtual bool push(const T e)
             {
                 if (tpos_ >= sz_) 
@@ -319,32 +993,110 @@ namespace framework
                 return sz_;
             }
 
-            inline array<T, 1>& operator= (array<T, 1>& rhs)
+            inline size_t pos(void) const
             {
-                if (sz_ != rhs.sz_)
-                    clear();
-                if (!element_) {
-                    sz_ = rhs.sz_;
-                    element_ = new T [sz_];
-                } 
+                return tpos_;
+            }
+
+            inline size_t count(void) const
+            {
+                return sz_;
+            }
+
+            inline T* data(void)
+            {
+                return element_;
+            }
+
+            inline const T* data(void) const
+            {
+                return element_;
+            }
+
+            // the elements are contiguous, plain pointers are the iterators
+            inline iterator begin(void)
+            {
+                return element_;
+            }
+
+            inline iterator end(void)
+            {
+                return element_ + sz_;
+            }
+
+            inline const_iterator begin(void) const
+            {
+                return element_;
+            }
+
+            inline const_iterator end(void) const
+            {
+                return element_ + sz_;
+            }
+
+            inline array_ref<T, 1> ref(void)
+            {
+                return make_ref_<T, default_access>(element_);
+            }
+
+            inline array_ref<const T, 1> ref(void) const
+            {
+                return make_ref_<const T, default_access>(element_);
+            }
+
+            inline array_ref<T, 1, checked_access> checked(void)
+            {
+                return make_ref_<T, checked_access>(element_);
+            }
+
+            inline array_ref<T, 1, unchecked_access> unchecked(void)
+            {
+                return make_ref_<T, unchecked_access>(element_);
+            }
+
+            // reuses the storage when it's large enough for rhs
+            inline array<T, 1>& operator= (const array<T, 1>& rhs)
+            {
+                if (this == &rhs) return *this;
+                fit_(rhs.sz_);
                 tpos_ = rhs.tpos_;
-                for (size_t i = 0; i < sz_; i++)
-                    element_[i] = rhs.element_[i];
+                simd::copy(element_, rhs.element_, sz_);
                 return *this;
             }
 
             template <typename T2>
-            inline array<T, 1>& operator= (array<T2, 1>& rhs)
+            inline array<T, 1>& operator= (const array<T2, 1>& rhs)
             {
-                if (sz_ != rhs.size())
-                    clear();
-                if (!element_) {
-                    sz_ = rhs.size();
-                    element_ = new T [sz_];
-                } 
-                tpos_ = rhs.pos();
-                for (size_t i = 0; i < sz_; i++)
-                    element_[i] = (T)rhs[i];
+                fit_(rhs.sz_);
+                tpos_ = rhs.tpos_;
+                simd::convert(element_, rhs.element_, sz_);
+                return *this;
+            }
+
+#ifdef FRAMEWORK_CXX11
+            // copies when either side's storage can't change hands, which
+            // may throw
+            inline array<T, 1>& operator= (array<T, 1>&& rhs)
+            {
+                if (this == &rhs) return *this;
+                if (!own_ || !rhs.own_ || borrowed_ || rhs.borrowed_)
+                    return operator= (static_cast<const array<T, 1>&>(rhs));
+                clear();
+                swap(rhs);
+                return *this;
+            }
+#endif
+
+            template <typename E>
+            inline array<T, 1>& operator= (const expr<E>& e)
+            {
+                if ((size_t)E::dimension != 1)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t n = e.size(0);
+                fit_(n);
+                T* p = element_;
+                for (size_t i = 0; i < n; i++)
+                    p[i] = static_cast<T>(e[i]);
                 return *this;
             }
 
@@ -373,9 +1125,128 @@ namespace framework
                 tpos_ = 0;
             }
 
+            // loads the elements from the start, like pushing each of them
+            // but with one size check for the range
+            template <typename It>
+            inline void assign(It first, It last)
+            {
+                load_(first, last, typename std::iterator_traits<It>::iterator_category());
+            }
+
+            // a single copy, memcpy for the trivially copyable types
+            template <typename T2>
+            inline void assign(T2* first, T2* last)
+            {
+                size_t n = static_cast<size_t>(last - first);
+                if (n > sz_)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                simd::convert(element_, first, n);
+                tpos_ = n;
+            }
+
+#ifdef FRAMEWORK_CXX11
+            inline void assign(std::initializer_list<T> l)
+            {
+                assign(l.begin(), l.end());
+            }
+
+            inline array<T, 1>& operator= (std::initializer_list<T> l)
+            {
+                assign(l.begin(), l.end());
+                return *this;
+            }
+#endif
+
+        protected:
+            inline void init_(void)
+            {
+                mem_ = default_resource();
+                reset_();
+            }
+
+            inline void seek_(size_t n)
+            {
+                tpos_ = n;
+            }
+
+            template <typename It>
+            inline void load_(It first, It last, std::forward_iterator_tag)
+            {
+                size_t n = static_cast<size_t>(std::distance(first, last));
+                if (n > sz_)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                for (T* p = element_; first != last; ++first)
+                    *p++ = static_cast<T>(*first);
+                tpos_ = n;
+            }
+
+            template <typename It>
+            inline void load_(It first, It last, std::input_iterator_tag)
+            {
+                for (tpos_ = 0; first != last; ++first) {
+                    if (tpos_ == sz_)
+                        throw(array_exception(array_exception::OUT_OF_RANGE));
+                    element_[tpos_++] = static_cast<T>(*first);
+                }
+            }
+
+            inline void reset_(void)
+            {
+                element_  = NULL;
+                sz_       = 0;
+                tpos_     = 0;
+                own_      = true;
+                borrowed_ = false;
+                cap_      = 0;
+            }
+
+            // uses storage owned by someone else, e.g. a file mapping
+            inline void attach_(T* data, const size_t* ext)
+            {
+                if (!own_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                array<T, 1>::clear();
+                element_  = data;
+                sz_       = ext[0];
+                cap_      = ext[0];
+                borrowed_ = true;
+            }
+
+            // makes room for n elements, reusing the storage if possible
+            inline void fit_(size_t n)
+            {
+                if (element_ && ((n == sz_) || (own_ && !borrowed_ && (n <= cap_)))) {
+                    sz_ = n;
+                    return;
+                }
+                set_size(n);
+            }
+
+            template <typename U, typename Access>
+            inline array_ref<U, 1, Access> make_ref_(U* data) const
+            {
+                size_t stride = 1;
+                return array_ref<U, 1, Access>(data, &sz_, &stride);
+            }
+
+            inline void bind_(T* data, const size_t* ext, array<T, 1>*)
+            {
+                element_ = data;
+                sz_      = ext[0];
+                cap_     = ext[0];
+                tpos_    = 0;
+                own_     = false;
+            }
+
     }; // class array<T, 1>
 
     // function templates
+
+    template <typename T, size_t dim>
+    inline void swap(array<T, dim>& a, array<T, dim>& b)
+    {
+        a.swap(b);
+    }
     
     template <typename T, size_t dim>
     inline array<T, dim>& operator, (array<T, dim>& ar, const T rhs)
@@ -391,22 +1262,36 @@ namespace framework
         return ar;
     }
 
+    // every element is formatted with the state of the stream, each
+    // sub-array ends with a row separator and each element with a separator
     template <typename T, size_t dim>
-    inline std::ostream& operator<< (std::ostream& os, array<T, dim>& ar)
+    inline void write_text(text_writer& w, const array<T, dim>& ar)
     {
-        std::stringstream oss;
         size_t sz = ar.size();
-        if (dim > 1)
-            for (size_t i = 0; i < sz; i++) {
-                oss.copyfmt(os);
-                oss << ar[i] << '\n';
-            }
-        else
-            for (size_t i = 0; i < sz; i++) {
-                oss.copyfmt(os);
-                oss << ar[i] << ' ';
-            }
-        return os << oss.str();
+        if (!sz)
+            w.empty();
+        for (size_t i = 0; i < sz; i++) {
+            write_text(w, ar[i]);
+            w.row();
+        }
+    }
+
+    template <typename T>
+    inline void write_text(text_writer& w, const array<T, 1>& ar)
+    {
+        size_t sz = ar.size();
+        if (!sz)
+            w.empty();
+        for (size_t i = 0; i < sz; i++) {
+            w.put(ar[i]);
+            w.separator();
+        }
+    }
+
+    template <typename T, size_t dim>
+    inline std::ostream& operator<< (std::ostream& os, const array<T, dim>& ar)
+    {
+        return print(os, ar);
     }
 
 } // namespace framework
@@ -14,42 +14,328 @@
 
 namespace framework
 {
-    template<typename T>
-    class buffer : public array<T, 1>
+    template <typename T> struct buffer_value_          { typedef T type; };
+    template <typename T> struct buffer_value_<const T> { typedef T type; };
+
+    // random-access iterator over the occupied elements of a buffer in
+    // logical order. the logical index is kept next to the element pointer,
+    // so a step only compares against the end of the storage instead of
+    // taking a modulo. it's invalidated by any push, pop or resize.
+    template <typename T>
+    class buffer_iterator
     {
-        using array<T, 1>::element_;
-        using array<T, 1>::sz_;
-        using array<T, 1>::tpos_;
+        template <typename U> friend class buffer_iterator;
+
+        public:
+            typedef std::random_access_iterator_tag         iterator_category;
+            typedef typename buffer_value_<T>::type         value_type;
+            typedef std::ptrdiff_t                          difference_type;
+            typedef T*                                      pointer;
+            typedef T&                                      reference;
 
         private:
+            T*      data_;
+            size_t  sz_;
+            size_t  hpos_;
+            size_t  idx_;       // logical index
+            T*      p_;         // its element
+
+            inline T* locate_(size_t idx) const
+            {
+                size_t rpos = idx + hpos_;
+                if (rpos >= sz_) rpos -= sz_;
+                return data_ + rpos;
+            }
+
+        public:
+            buffer_iterator() : data_(NULL), sz_(0), hpos_(0), idx_(0), p_(NULL) {}
+
+            buffer_iterator(T* data, size_t sz, size_t hpos, size_t idx)
+                : data_(data), sz_(sz), hpos_(hpos), idx_(idx), p_(locate_(idx)) {}
+
+            // iterator to const_iterator
+            template <typename U>
+            buffer_iterator(const buffer_iterator<U>& other)
+                : data_(other.data_), sz_(other.sz_), hpos_(other.hpos_),
+                  idx_(other.idx_), p_(other.p_) {}
+
+            inline T& operator* () const                        { return *p_; }
+            inline T* operator-> () const                       { return p_; }
+            inline T& operator[] (difference_type n) const      { return *locate_(idx_ + n); }
+
+            inline buffer_iterator& operator++ ()
+            {
+                ++idx_;
+                if (++p_ == data_ + sz_) p_ = data_;
+                return *this;
+            }
+
+            inline buffer_iterator& operator-- ()
+            {
+                --idx_;
+                if (p_ == data_) p_ += sz_;
+                --p_;
+                return *this;
+            }
+
+            inline buffer_iterator operator++ (int)
+            {
+                buffer_iterator t = *this;
+                ++*this;
+                return t;
+            }
+
+            inline buffer_iterator operator-- (int)
+            {
+                buffer_iterator t = *this;
+                --*this;
+                return t;
+            }
+
+            inline buffer_iterator& operator+= (difference_type n)
+            {
+                idx_ += n;
+                p_    = locate_(idx_);
+                return *this;
+            }
+
+            inline buffer_iterator& operator-= (difference_type n)
+            {
+                return operator+= (-n);
+            }
+
+            inline buffer_iterator operator+ (difference_type n) const
+            {
+                buffer_iterator t = *this;
+                return t += n;
+            }
+
+            inline buffer_iterator operator- (difference_type n) const
+            {
+                buffer_iterator t = *this;
+                return t += -n;
+            }
+
+            template <typename U>
+            inline difference_type operator- (const buffer_iterator<U>& rhs) const
+            {
+                return static_cast<difference_type>(idx_) - static_cast<difference_type>(rhs.idx_);
+            }
+
+            template <typename U> inline bool operator== (const buffer_iterator<U>& rhs) const { return idx_ == rhs.idx_; }
+            template <typename U> inline bool operator!= (const buffer_iterator<U>& rhs) const { return idx_ != rhs.idx_; }
+            template <typename U> inline bool operator<  (const buffer_iterator<U>& rhs) const { return idx_ <  rhs.idx_; }
+            template <typename U> inline bool operator>  (const buffer_iterator<U>& rhs) const { return idx_ >  rhs.idx_; }
+            template <typename U> inline bool operator<= (const buffer_iterator<U>& rhs) const { return idx_ <= rhs.idx_; }
+            template <typename U> inline bool operator>= (const buffer_iterator<U>& rhs) const { return idx_ >= rhs.idx_; }
+
+    }; // class buffer_iterator<T>
+
+    template <typename T>
+    inline buffer_iterator<T> operator+ (std::ptrdiff_t n, const buffer_iterator<T>& it)
+    {
+        return it + n;
+    }
+
+    // the elements of a region of a buffer in order, as at most two
+    // contiguous runs since it may wrap around the end of the storage
+    template <typename T>
+    struct buffer_span
+    {
+        T*      first;
+        size_t  first_size;
+        T*      second;
+        size_t  second_size;
+
+        inline size_t size(void) const
+        {
+            return first_size + second_size;
+        }
+    };
+
+    // non-virtual reference to the occupied elements of a buffer in
+    // logical order. it's invalidated by any push, pop or resize.
+    template <typename T, typename Access = default_access>
+    class buffer_ref
+    {
+        protected:
+            T*      data_;
+            size_t  sz_;
             size_t  occupied_;
             size_t  hpos_;
 
         public:
-            buffer() : array<T, 1>(), occupied_(0), hpos_(0) {}
+            typedef buffer_iterator<T> iterator;
 
-            buffer(size_t s1) : array<T, 1>(s1), occupied_(0), hpos_(0) {}
+            buffer_ref() : data_(NULL), sz_(0), occupied_(0), hpos_(0) {}
 
-            buffer(buffer<T>& other)
+            buffer_ref(T* data, size_t sz, size_t occupied, size_t hpos)
+                : data_(data), sz_(sz), occupied_(occupied), hpos_(hpos) {}
+
+            inline T& operator[] (size_t idx) const
+            {
+                Access::check(idx, occupied_, data_);
+                size_t rpos = idx + hpos_;
+                if (rpos >= sz_) rpos -= sz_;
+                return data_[rpos];
+            }
+
+            inline T& at(size_t idx) const
+            {
+                return operator[](idx);
+            }
+
+            inline size_t size(void) const
+            {
+                return occupied_;
+            }
+
+            inline size_t capacity(void) const
+            {
+                return sz_;
+            }
+
+            inline iterator begin(void) const
+            {
+                return iterator(data_, sz_, hpos_, 0);
+            }
+
+            inline iterator end(void) const
+            {
+                return iterator(data_, sz_, hpos_, occupied_);
+            }
+
+    }; // class buffer_ref<T, Access>
+
+    // what push does when every slot is occupied
+    enum full_policy
+    {
+        OVERWRITE,      // the oldest element is dropped, counted in overwritten()
+        REJECT,         // the new element is dropped, counted in dropped()
+        GROW            // the storage grows, see reserve()
+    };
+
+    template<typename T>
+    class buffer : public array<T, 1>
+    {
+        protected:
+            using array<T, 1>::element_;
+            using array<T, 1>::sz_;
+            using array<T, 1>::tpos_;
+
+        private:
+            size_t      occupied_;
+            size_t      hpos_;
+            size_t      mask_;          // sz_ - 1 for a power of two, else 0
+            full_policy policy_;
+            size_t      dropped_;
+            size_t      overwritten_;
+
+        public:
+            typedef buffer_iterator<T>          iterator;
+            typedef buffer_iterator<const T>    const_iterator;
+
+            buffer() : array<T, 1>(), occupied_(0), hpos_(0), mask_(0),
+                       policy_(OVERWRITE), dropped_(0), overwritten_(0) {}
+
+            buffer(size_t s1) : array<T, 1>(s1), occupied_(0), hpos_(0), mask_(0),
+                                policy_(OVERWRITE), dropped_(0), overwritten_(0)
+            {
+                reshape_();
+            }
+
+            buffer(const buffer<T>& other) : array<T, 1>(), occupied_(0), hpos_(0), mask_(0),
+                                             policy_(OVERWRITE), dropped_(0), overwritten_(0)
             {
-                element_ = NULL;
-                sz_      = 0;
                 operator= (other);
             }
 
             template <typename T2>
-            buffer(buffer<T2>& other)
+            buffer(const buffer<T2>& other) : array<T, 1>(), occupied_(0), hpos_(0), mask_(0),
+                                              policy_(OVERWRITE), dropped_(0), overwritten_(0)
             {
-                element_ = NULL;
-                sz_      = 0;
                 operator= (other);
             }
 
+#ifdef FRAMEWORK_CXX11
+            // copies like the array it builds on when other's storage
+            // can't change hands
+            buffer(buffer<T>&& other)
+                : array<T, 1>(std::move(other)),
+                  occupied_(other.occupied_), hpos_(other.hpos_), mask_(other.mask_),
+                  policy_(other.policy_), dropped_(other.dropped_), overwritten_(other.overwritten_)
+            {
+                other.occupied_ = 0;
+                other.hpos_     = 0;
+                other.mask_     = 0;
+            }
+#endif
+
+            // these drop the elements, reserve() keeps them
+            inline void set_size(size_t s1)
+            {
+                array<T, 1>::set_size(s1);
+                linear_(0);
+            }
+
+            inline void resize(size_t s1)
+            {
+                array<T, 1>::resize(s1);
+                linear_(0);
+            }
+
             inline virtual void clear()
             {
                 array<T, 1>::clear();
                 occupied_ = 0;
                 hpos_     = 0;
+                mask_     = 0;
+            }
+
+            // room for at least n elements, keeping the occupied ones in
+            // order. the new storage has a power-of-two size, so the index
+            // wraps with a mask from then on, and it's linearized with the
+            // oldest element at index 0. the resource stays the same.
+            inline void reserve(size_t n)
+            {
+                if (element_ && (n <= sz_)) return;
+                size_t cap = 1;
+                while (cap < n) cap <<= 1;
+                array<T, 1> t;
+                t.set_resource(this->resource());
+                t.set_size(cap);
+                buffer_span<T> r = peek();
+                simd::convert(t.data(), r.first, r.first_size);
+                simd::convert(t.data() + r.first_size, r.second, r.second_size);
+                size_t n0 = occupied_;
+                array<T, 1>::swap(t);
+                linear_(n0);
+            }
+
+            inline void set_policy(full_policy p)
+            {
+                policy_ = p;
+            }
+
+            inline full_policy policy(void) const
+            {
+                return policy_;
+            }
+
+            // elements lost to REJECT and OVERWRITE since the last reset
+            inline size_t dropped(void) const
+            {
+                return dropped_;
+            }
+
+            inline size_t overwritten(void) const
+            {
+                return overwritten_;
+            }
+
+            inline void reset_counters(void)
+            {
+                dropped_ = overwritten_ = 0;
             }
 
             inline virtual T& operator[] (size_t idx)
@@ -58,9 +344,16 @@ namespace framework
                     throw(array_exception(array_exception::OUT_OF_RANGE));
                 if (!element_)
                     throw(array_exception(array_exception::NOT_ALLOCATED));
-                size_t rpos = idx + hpos_;
-                if (rpos >= sz_) rpos -= sz_;
-                return element_[rpos];
+                return element_[advance_(hpos_, idx)];
+            }
+
+            inline virtual const T& operator[] (size_t idx) const
+            {
+                if (idx >= occupied_)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                if (!element_)
+                    throw(array_exception(array_exception::NOT_ALLOCATED));
+                return element_[advance_(hpos_, idx)];
             }
 
             inline virtual T& at(size_t idx)
@@ -68,81 +361,370 @@ namespace framework
                 return operator[](idx);
             }
 
+            inline virtual const T& at(size_t idx) const
+            {
+                return operator[](idx);
+            }
+
+            // false if the element was rejected
             inline virtual bool push(const T e)
             {
+                if ((occupied_ == sz_) && (policy_ != OVERWRITE)) {
+                    if (policy_ == REJECT) {
+                        ++dropped_;
+                        return false;
+                    }
+                    reserve(sz_ + 1);
+                }
                 if (!element_)
                     throw(array_exception(array_exception::NOT_ALLOCATED));
                 element_[tpos_] = e;
-                if (++tpos_ == sz_) tpos_ = 0;
-                if (++occupied_ > sz_) {
-                    if (++hpos_ == sz_) hpos_ = 0;
-                    --occupied_;
+                tpos_ = advance_(tpos_, 1);
+                if (occupied_ == sz_) {
+                    hpos_ = advance_(hpos_, 1);
+                    ++overwritten_;
+                } else {
+                    ++occupied_;
                 }
                 return true;
             }
 
-            inline T& pop(void)
+            // n elements at once, a copy per contiguous run, following the
+            // policy like pushing them one by one. returns how many were
+            // stored.
+            template <typename T2>
+            inline size_t push(const T2* p, size_t n)
+            {
+                if (!n) return 0;
+                if (policy_ == REJECT) {
+                    size_t free = sz_ - occupied_;
+                    if (n > free) {
+                        dropped_ += n - free;
+                        n = free;
+                    }
+                    if (!n) return 0;
+                } else if (policy_ == GROW) {
+                    reserve(occupied_ + n);
+                }
+                if (!element_)
+                    throw(array_exception(array_exception::NOT_ALLOCATED));
+                if (occupied_ + n > sz_)
+                    overwritten_ += occupied_ + n - sz_;
+                if (n >= sz_) {
+                    simd::convert(element_, p + (n - sz_), sz_);
+                    linear_(sz_);
+                    return n;
+                }
+                size_t n1 = std::min(n, sz_ - tpos_);
+                simd::convert(element_ + tpos_, p, n1);
+                simd::convert(element_, p + n1, n - n1);
+                tpos_ = advance_(tpos_, n);
+                occupied_ += n;
+                if (occupied_ > sz_) {
+                    hpos_     = advance_(hpos_, occupied_ - sz_);
+                    occupied_ = sz_;
+                }
+                return n;
+            }
+
+            // by value, the slot is free for the next push
+            inline T pop(void)
             {
                 if (!occupied_) 
                     throw(array_exception(array_exception::EMPTY));
                 if (!element_)
                     throw(array_exception(array_exception::NOT_ALLOCATED));
                 size_t rpos = hpos_;
-                if (++hpos_ == sz_) hpos_ = 0;
+                hpos_ = advance_(hpos_, 1);
                 --occupied_;
                 return element_[rpos];
             }
 
+            // the oldest min(n, occupied()) elements into d, returns how many
+            template <typename T2>
+            inline size_t pop(T2* d, size_t n)
+            {
+                buffer_span<T> r = peek();
+                if (n > r.size()) n = r.size();
+                size_t n1 = std::min(n, r.first_size);
+                simd::convert(d, r.first, n1);
+                simd::convert(d + n1, r.second, n - n1);
+                consume(n);
+                return n;
+            }
+
+            // the occupied elements, oldest first, to be read in place
+            // and released with consume()
+            inline buffer_span<T> peek(void)
+            {
+                size_t n1 = std::min(occupied_, sz_ - hpos_);
+                buffer_span<T> r = { element_ + hpos_, n1, element_, occupied_ - n1 };
+                return r;
+            }
+
+            inline buffer_span<const T> peek(void) const
+            {
+                size_t n1 = std::min(occupied_, sz_ - hpos_);
+                buffer_span<const T> r = { element_ + hpos_, n1, element_, occupied_ - n1 };
+                return r;
+            }
+
+            inline void consume(size_t n)
+            {
+                if (n > occupied_)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                hpos_      = advance_(hpos_, n);
+                occupied_ -= n;
+            }
+
+            // the free slots after the newest element, to be written in
+            // place and added with commit()
+            inline buffer_span<T> prepare(void)
+            {
+                size_t free = sz_ - occupied_;
+                size_t n1   = std::min(free, sz_ - tpos_);
+                buffer_span<T> r = { element_ + tpos_, n1, element_, free - n1 };
+                return r;
+            }
+
+            inline void commit(size_t n)
+            {
+                if (n > sz_ - occupied_)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                tpos_      = advance_(tpos_, n);
+                occupied_ += n;
+            }
+
             inline size_t occupied(void) const
             {
                 return occupied_;
             }
 
-            inline buffer<T>& operator= (buffer<T>& rhs)
+            // physical index of the oldest element
+            inline size_t head(void) const
             {
-                if (sz_ != rhs.sz_)
-                    clear();
-                if (!element_) {
-                    sz_ = rhs.sz_;
-                    element_ = new T [sz_];
-                } 
-                occupied_ = 0;
-                hpos_     = 0;
-                tpos_     = 0;
-                for (size_t i = 0, l = rhs.occupied_; i < l; i++)
-                    this->push(rhs[i]);
+                return hpos_;
+            }
+
+            // the occupied elements, oldest first
+            inline iterator begin(void)
+            {
+                return iterator(element_, sz_, hpos_, 0);
+            }
+
+            inline iterator end(void)
+            {
+                return iterator(element_, sz_, hpos_, occupied_);
+            }
+
+            inline const_iterator begin(void) const
+            {
+                return const_iterator(element_, sz_, hpos_, 0);
+            }
+
+            inline const_iterator end(void) const
+            {
+                return const_iterator(element_, sz_, hpos_, occupied_);
+            }
+
+            inline buffer_ref<T> ref(void)
+            {
+                return buffer_ref<T>(element_, sz_, occupied_, hpos_);
+            }
+
+            inline buffer_ref<T, checked_access> checked(void)
+            {
+                return buffer_ref<T, checked_access>(element_, sz_, occupied_, hpos_);
+            }
+
+            inline buffer_ref<T, unchecked_access> unchecked(void)
+            {
+                return buffer_ref<T, unchecked_access>(element_, sz_, occupied_, hpos_);
+            }
+
+            inline void swap(buffer<T>& other)
+            {
+                array<T, 1>::swap(other);
+                std::swap(occupied_,    other.occupied_);
+                std::swap(hpos_,        other.hpos_);
+                std::swap(mask_,        other.mask_);
+                std::swap(policy_,      other.policy_);
+                std::swap(dropped_,     other.dropped_);
+                std::swap(overwritten_, other.overwritten_);
+            }
+
+            // the copy is linearized, its oldest element lands at index 0.
+            // the policy and the counters come along, as with a move.
+            inline buffer<T>& operator= (const buffer<T>& rhs)
+            {
+                if (this == &rhs) return *this;
+                this->fit_(rhs.size());
+                copy_(rhs);
                 return *this;
             }
 
             template <typename T2>
-            inline buffer<T>& operator= (buffer<T2>& rhs)
-            {
-                if (sz_ != rhs.size())
-                    clear();
-                if (!element_) {
-                    sz_ = rhs.size();
-                    element_ = new T [sz_];
-                } 
-                occupied_ = 0;
-                hpos_     = 0;
-                tpos_     = 0;
-                for (size_t i = 0, l = rhs.occupied(); i < l; i++)
-                    this->push((T)rhs[i]);
+            inline buffer<T>& operator= (const buffer<T2>& rhs)
+            {
+                this->fit_(rhs.size());
+                copy_(rhs);
+                return *this;
+            }
+
+#ifdef FRAMEWORK_CXX11
+            // copies when either side's storage can't change hands
+            inline buffer<T>& operator= (buffer<T>&& rhs)
+            {
+                if (this == &rhs) return *this;
+                if (!this->own_ || !rhs.own_ || this->borrowed_ || rhs.borrowed_)
+                    return operator= (static_cast<const buffer<T>&>(rhs));
+                clear();
+                swap(rhs);
                 return *this;
             }
+#endif
+
+            // replaces the contents with the range, oldest first, as if
+            // each element were pushed into the emptied buffer: GROW keeps
+            // all of them, OVERWRITE the newest size() and REJECT the first
+            // size(), counting the rest in overwritten() or dropped().
+            template <typename It>
+            inline void assign(It first, It last)
+            {
+                load_(first, last, typename std::iterator_traits<It>::iterator_category());
+            }
+
+            template <typename T2>
+            inline void assign(T2* first, T2* last)
+            {
+                size_t skip;
+                size_t n = place_(static_cast<size_t>(last - first), skip);
+                simd::convert(element_, first + skip, n);
+                linear_(n);
+            }
+
+#ifdef FRAMEWORK_CXX11
+            inline void assign(std::initializer_list<T> l)
+            {
+                assign(l.begin(), l.end());
+            }
+
+            inline buffer<T>& operator= (std::initializer_list<T> l)
+            {
+                assign(l.begin(), l.end());
+                return *this;
+            }
+#endif
+
+        protected:
+            // n <= sz_
+            inline size_t advance_(size_t pos, size_t n) const
+            {
+                pos += n;
+                if (mask_) return pos & mask_;
+                return (pos >= sz_) ? pos - sz_ : pos;
+            }
+
+            inline void reshape_(void)
+            {
+                mask_ = ((sz_ > 1) && !(sz_ & (sz_ - 1))) ? sz_ - 1 : 0;
+            }
+
+            // n elements stored from index 0 on, after any change of sz_
+            inline void linear_(size_t n)
+            {
+                occupied_ = n;
+                hpos_     = 0;
+                tpos_     = (n == sz_) ? 0 : n;
+                reshape_();
+            }
+
+            inline void attach_(T* data, const size_t* ext)
+            {
+                array<T, 1>::attach_(data, ext);
+                linear_(0);
+            }
+
+            // empties the buffer for n incoming elements and returns how
+            // many of them to store from index 0, after skipping the first
+            // skip, following the policy like push
+            inline size_t place_(size_t n, size_t& skip)
+            {
+                linear_(0);
+                skip = 0;
+                if (policy_ == GROW)
+                    reserve(n);
+                if (n && !element_ && (policy_ != REJECT))
+                    throw(array_exception(array_exception::NOT_ALLOCATED));
+                if (n > sz_) {
+                    if (policy_ == REJECT) {
+                        dropped_ += n - sz_;
+                    } else {
+                        skip = n - sz_;
+                        overwritten_ += skip;
+                    }
+                    n = sz_;
+                }
+                return n;
+            }
+
+            template <typename It>
+            inline void load_(It first, It last, std::forward_iterator_tag)
+            {
+                size_t skip;
+                size_t n = place_(static_cast<size_t>(std::distance(first, last)), skip);
+                std::advance(first, skip);
+                for (T* p = element_; p != element_ + n; ++first)
+                    *p++ = static_cast<T>(*first);
+                linear_(n);
+            }
+
+            template <typename It>
+            inline void load_(It first, It last, std::input_iterator_tag)
+            {
+                linear_(0);
+                for (; first != last; ++first)
+                    push(static_cast<T>(*first));
+            }
+
+            template <typename T2>
+            inline void copy_(const buffer<T2>& rhs)
+            {
+                size_t n1 = rhs.size() - rhs.head();
+                if (n1 > rhs.occupied()) n1 = rhs.occupied();
+                simd::convert(element_, rhs.data() + rhs.head(), n1);
+                simd::convert(element_ + n1, rhs.data(), rhs.occupied() - n1);
+                linear_(rhs.occupied());
+                policy_      = rhs.policy();
+                dropped_     = rhs.dropped();
+                overwritten_ = rhs.overwritten();
+            }
 
     }; // class buffer<T>
 
+    // the occupied elements oldest first, straight from both segments
     template <typename T>
-    inline std::ostream& operator<< (std::ostream& os, buffer<T>& bf)
+    inline void write_text(text_writer& w, const buffer<T>& bf)
     {
-        std::stringstream oss;
-        size_t sz = bf.occupied();
-        for (size_t i = 0; i < sz; i++) {
-            oss.copyfmt(os);
-            oss << bf[i] << ' ';
+        size_t n1 = bf.size() - bf.head();
+        if (n1 > bf.occupied()) n1 = bf.occupied();
+        if (!bf.occupied())
+            w.empty();
+        const T* p = bf.data() + bf.head();
+        for (size_t i = 0; i < n1; i++) {
+            w.put(p[i]);
+            w.separator();
         }
-        return os << oss.str();
+        for (size_t i = 0; i < bf.occupied() - n1; i++) {
+            w.put(bf.data()[i]);
+            w.separator();
+        }
+    }
+
+    template <typename T>
+    inline std::ostream& operator<< (std::ostream& os, const buffer<T>& bf)
+    {
+        return print(os, bf);
     }
 
 } // namespace framework
@@ -0,0 +1,333 @@
+//
+// expression.h
+//
+// expression templates for lazy element-wise arithmetic on array
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __EXPRESSION_H__
+#define __EXPRESSION_H__
+
+#include <cmath>
+#include <cstdlib>
+
+#include "array.h"
+
+namespace framework
+{
+    // scalar types which broadcast over an array in an expression
+    template <typename T> struct scalar_rank { enum { value = 0 }; };
+
+    template <> struct scalar_rank<char>                { enum { value = 1 }; };
+    template <> struct scalar_rank<signed char>         { enum { value = 1 }; };
+    template <> struct scalar_rank<unsigned char>       { enum { value = 2 }; };
+    template <> struct scalar_rank<short>               { enum { value = 3 }; };
+    template <> struct scalar_rank<unsigned short>      { enum { value = 4 }; };
+    template <> struct scalar_rank<int>                 { enum { value = 5 }; };
+    template <> struct scalar_rank<unsigned int>        { enum { value = 6 }; };
+    template <> struct scalar_rank<long>                { enum { value = 7 }; };
+    template <> struct scalar_rank<unsigned long>       { enum { value = 8 }; };
+    template <> struct scalar_rank<float>               { enum { value = 9 }; };
+    template <> struct scalar_rank<double>              { enum { value = 10 }; };
+    template <> struct scalar_rank<long double>         { enum { value = 11 }; };
+
+    template <bool c, typename T1, typename T2>
+    struct select_type { typedef T1 type; };
+
+    template <typename T1, typename T2>
+    struct select_type<false, T1, T2> { typedef T2 type; };
+
+    // value type of a mixed-type expression, int op float gives float
+    template <typename T1, typename T2>
+    struct promote
+    {
+        typedef typename select_type<
+            (int)scalar_rank<T1>::value >= (int)scalar_rank<T2>::value,
+            T1, T2>::type type;
+    };
+
+    // value type of the transcendental functions
+    template <typename T>
+    struct float_type
+    {
+        typedef typename select_type<
+            (int)scalar_rank<T>::value >= (int)scalar_rank<float>::value,
+            T, double>::type type;
+    };
+
+    template <typename E> class expr;
+
+    // leaves of an expression tree
+
+    template <typename T, size_t dim>
+    class array_leaf
+    {
+        protected:
+            const T*    p_;
+            size_t      ext_[dim];
+
+        public:
+            typedef T value_type;
+            enum { dimension = dim };
+
+            array_leaf(const array<T, dim>& ar) : p_(ar.data())
+            {
+                for (size_t k = 0; k < dim; k++)
+                    ext_[k] = ar.size(k);
+            }
+
+            inline T operator[] (size_t i) const
+            {
+                return p_[i];
+            }
+
+            inline size_t size(size_t k) const
+            {
+                return ext_[k];
+            }
+
+    }; // class array_leaf<T, dim>
+
+    template <typename T>
+    class scalar_leaf
+    {
+        protected:
+            T   v_;
+
+        public:
+            typedef T value_type;
+            enum { dimension = 0 };
+
+            scalar_leaf(const T v) : v_(v) {}
+
+            inline T operator[] (size_t) const
+            {
+                return v_;
+            }
+
+            inline size_t size(size_t) const
+            {
+                return 0;
+            }
+
+    }; // class scalar_leaf<T>
+
+    // nodes of an expression tree
+
+    template <typename Op, typename L, typename R>
+    class binary_expr
+    {
+        protected:
+            L   l_;
+            R   r_;
+
+        public:
+            typedef typename promote<typename L::value_type,
+                                     typename R::value_type>::type value_type;
+            enum { dimension = (int)L::dimension != 0 ? (int)L::dimension
+                                                      : (int)R::dimension };
+
+            binary_expr(const L& l, const R& r) : l_(l), r_(r)
+            {
+                const int ldim = L::dimension, rdim = R::dimension;
+                if ((ldim != 0) && (rdim != 0)) {
+                    if (ldim != rdim)
+                        throw(array_exception(array_exception::DIM_ERROR));
+                    for (size_t k = 0; k < (size_t)ldim; k++)
+                        if (l_.size(k) != r_.size(k))
+                            throw(array_exception(array_exception::DIM_ERROR));
+                }
+            }
+
+            inline value_type operator[] (size_t i) const
+            {
+                return Op::template apply<value_type>(l_[i], r_[i]);
+            }
+
+            inline size_t size(size_t k) const
+            {
+                return ((int)L::dimension != 0) ? l_.size(k) : r_.size(k);
+            }
+
+    }; // class binary_expr<Op, L, R>
+
+    template <typename Op, typename E>
+    class unary_expr
+    {
+        protected:
+            E   e_;
+
+        public:
+            typedef typename Op::template result<
+                typename E::value_type>::type value_type;
+            enum { dimension = E::dimension };
+
+            unary_expr(const E& e) : e_(e) {}
+
+            inline value_type operator[] (size_t i) const
+            {
+                return Op::template apply<value_type>(e_[i]);
+            }
+
+            inline size_t size(size_t k) const
+            {
+                return e_.size(k);
+            }
+
+    }; // class unary_expr<Op, E>
+
+    // the handle every operator returns. array::operator= evaluates it
+    // in a single pass straight into the destination storage.
+    template <typename E>
+    class expr
+    {
+        protected:
+            E   e_;
+
+        public:
+            typedef typename E::value_type value_type;
+            enum { dimension = E::dimension };
+
+            expr(const E& e) : e_(e) {}
+
+            inline value_type operator[] (size_t i) const
+            {
+                return e_[i];
+            }
+
+            inline size_t size(size_t k = 0) const
+            {
+                return e_.size(k);
+            }
+
+            inline size_t count(void) const
+            {
+                size_t n = 1;
+                for (size_t k = 0; k < dimension; k++)
+                    n *= e_.size(k);
+                return n;
+            }
+
+            inline const E& node(void) const
+            {
+                return e_;
+            }
+
+    }; // class expr<E>
+
+    // maps an operand to its expression node
+    template <typename X>
+    struct expr_traits
+    {
+        enum { is_operand = scalar_rank<X>::value != 0, is_expr = 0 };
+        typedef scalar_leaf<X> type;
+
+        static inline type make(const X& x) { return type(x); }
+    };
+
+    template <typename T, size_t dim>
+    struct expr_traits< array<T, dim> >
+    {
+        enum { is_operand = 1, is_expr = 1 };
+        typedef array_leaf<T, dim> type;
+
+        static inline type make(const array<T, dim>& x) { return type(x); }
+    };
+
+    template <typename E>
+    struct expr_traits< expr<E> >
+    {
+        enum { is_operand = 1, is_expr = 1 };
+        typedef E type;
+
+        static inline const type& make(const expr<E>& x) { return x.node(); }
+    };
+
+    template <typename Op, typename L, typename R,
+              bool ok = expr_traits<L>::is_operand && expr_traits<R>::is_operand
+                     && (expr_traits<L>::is_expr || expr_traits<R>::is_expr)>
+    struct binary_result {};
+
+    template <typename Op, typename L, typename R>
+    struct binary_result<Op, L, R, true>
+    {
+        typedef binary_expr<Op, typename expr_traits<L>::type,
+                                typename expr_traits<R>::type> node;
+        typedef expr<node> type;
+    };
+
+    template <typename Op, typename X, bool ok = expr_traits<X>::is_expr>
+    struct unary_result {};
+
+    template <typename Op, typename X>
+    struct unary_result<Op, X, true>
+    {
+        typedef unary_expr<Op, typename expr_traits<X>::type> node;
+        typedef expr<node> type;
+    };
+
+    // operations
+
+    #define FRAMEWORK_BINARY_OP(name, op)                                   \
+    struct name                                                             \
+    {                                                                       \
+        template <typename R, typename A, typename B>                       \
+        static inline R apply(const A a, const B b)                         \
+        {                                                                   \
+            return static_cast<R>(a op b);                                  \
+        }                                                                   \
+    };                                                                      \
+                                                                            \
+    template <typename L, typename R>                                       \
+    inline typename binary_result<name, L, R>::type                         \
+    operator op (const L& l, const R& r)                                    \
+    {                                                                       \
+        typedef binary_result<name, L, R> result;                           \
+        return typename result::type(typename result::node(                 \
+            expr_traits<L>::make(l), expr_traits<R>::make(r)));             \
+    }
+
+    FRAMEWORK_BINARY_OP(op_add, +)
+    FRAMEWORK_BINARY_OP(op_sub, -)
+    FRAMEWORK_BINARY_OP(op_mul, *)
+    FRAMEWORK_BINARY_OP(op_div, /)
+
+    #undef FRAMEWORK_BINARY_OP
+
+    #define FRAMEWORK_UNARY_OP(name, func, result_type, body)               \
+    struct name                                                             \
+    {                                                                       \
+        template <typename T>                                               \
+        struct result { typedef result_type type; };                        \
+                                                                            \
+        template <typename R, typename A>                                   \
+        static inline R apply(const A a)                                    \
+        {                                                                   \
+            return static_cast<R>(body);                                    \
+        }                                                                   \
+    };                                                                      \
+                                                                            \
+    template <typename X>                                                   \
+    inline typename unary_result<name, X>::type func (const X& x)           \
+    {                                                                       \
+        typedef unary_result<name, X> result;                               \
+        return typename result::type(                                       \
+            typename result::node(expr_traits<X>::make(x)));                \
+    }
+
+    FRAMEWORK_UNARY_OP(op_neg,  operator-, T, -a)
+    FRAMEWORK_UNARY_OP(op_abs,  abs,  T, a < A(0) ? -a : a)
+    FRAMEWORK_UNARY_OP(op_sqrt, sqrt, typename float_type<T>::type, std::sqrt(static_cast<R>(a)))
+    FRAMEWORK_UNARY_OP(op_exp,  exp,  typename float_type<T>::type, std::exp(static_cast<R>(a)))
+    FRAMEWORK_UNARY_OP(op_log,  log,  typename float_type<T>::type, std::log(static_cast<R>(a)))
+    FRAMEWORK_UNARY_OP(op_sin,  sin,  typename float_type<T>::type, std::sin(static_cast<R>(a)))
+    FRAMEWORK_UNARY_OP(op_cos,  cos,  typename float_type<T>::type, std::cos(static_cast<R>(a)))
+    FRAMEWORK_UNARY_OP(op_tanh, tanh, typename float_type<T>::type, std::tanh(static_cast<R>(a)))
+
+    #undef FRAMEWORK_UNARY_OP
+
+} // namespace framework
+
+#endif // __EXPRESSION_H__
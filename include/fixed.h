@@ -0,0 +1,321 @@
+//
+// fixed.h
+//
+// array class template with compile-time extents and inline storage
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include "array.h"
+#include "view.h"
+
+#ifdef FRAMEWORK_CXX11
+#define FRAMEWORK_CONSTEXPR     constexpr
+#else
+#define FRAMEWORK_CONSTEXPR
+#endif
+
+// element loops up to this many elements are unrolled by template
+#ifndef FRAMEWORK_FIXED_UNROLL
+#define FRAMEWORK_FIXED_UNROLL  16
+#endif
+
+namespace framework
+{
+    // nested built-in array of the extents, an extent of 0 ends the shape
+    template <typename T, size_t N1, size_t N2, size_t N3>
+    struct fixed_storage_
+    {
+        typedef T type[N1][N2][N3];
+        typedef T row[N2][N3];
+    };
+
+    template <typename T, size_t N1, size_t N2>
+    struct fixed_storage_<T, N1, N2, 0>
+    {
+        typedef T type[N1][N2];
+        typedef T row[N2];
+    };
+
+    template <typename T, size_t N1>
+    struct fixed_storage_<T, N1, 0, 0>
+    {
+        typedef T type[N1];
+        typedef T row;
+    };
+
+    // op(d[i], s[i]) or op(d[i], v) for i in [0, N), written out when N is small
+    template <size_t N, bool unrolled = (N <= FRAMEWORK_FIXED_UNROLL)>
+    struct fixed_unroll_
+    {
+        template <typename T, typename U, typename Op>
+        static inline void apply(T* d, const U* s, Op op)
+        {
+            fixed_unroll_<N-1>::apply(d, s, op);
+            op(d[N-1], s[N-1]);
+        }
+
+        template <typename T, typename U, typename Op>
+        static inline void apply_value(T* d, const U& v, Op op)
+        {
+            fixed_unroll_<N-1>::apply_value(d, v, op);
+            op(d[N-1], v);
+        }
+    };
+
+    template <>
+    struct fixed_unroll_<0, true>
+    {
+        template <typename T, typename U, typename Op>
+        static inline void apply(T*, const U*, Op) {}
+
+        template <typename T, typename U, typename Op>
+        static inline void apply_value(T*, const U&, Op) {}
+    };
+
+    template <size_t N>
+    struct fixed_unroll_<N, false>
+    {
+        template <typename T, typename U, typename Op>
+        static inline void apply(T* d, const U* s, Op op)
+        {
+            for (size_t i = 0; i < N; i++) op(d[i], s[i]);
+        }
+
+        template <typename T, typename U, typename Op>
+        static inline void apply_value(T* d, const U& v, Op op)
+        {
+            for (size_t i = 0; i < N; i++) op(d[i], v);
+        }
+    };
+
+    struct fixed_assign_ { template <typename A, typename B> void operator() (A& a, const B& b) const { a = b; } };
+    struct fixed_add_    { template <typename A, typename B> void operator() (A& a, const B& b) const { a += b; } };
+    struct fixed_sub_    { template <typename A, typename B> void operator() (A& a, const B& b) const { a -= b; } };
+    struct fixed_mul_    { template <typename A, typename B> void operator() (A& a, const B& b) const { a *= b; } };
+    struct fixed_div_    { template <typename A, typename B> void operator() (A& a, const B& b) const { a /= b; } };
+
+    // array of N1 x N2 x N3 elements held in the object itself, e.g.
+    // fixed_array<float, 4, 4>. the shape is checked while compiling and
+    // nothing is allocated, so it's as cheap to create as a plain struct;
+    // like one, its elements are left uninitialized. only the first index
+    // is checked, by default_access.
+    template <typename T, size_t N1, size_t N2 = 0, size_t N3 = 0>
+    class fixed_array
+    {
+        public:
+            enum {
+                dimension = N3 ? 3 : (N2 ? 2 : 1),
+                SIZE      = N1 * (N2 ? N2 : 1) * (N3 ? N3 : 1)
+            };
+
+            typedef T value_type;
+            typedef typename fixed_storage_<T, N1, N2, N3>::type storage_type;
+            typedef typename fixed_storage_<T, N1, N2, N3>::row  row_type;
+
+        private:
+            // every extent but trailing zeros has to be positive
+            typedef char shape_check_[((N1 > 0) && (N2 || !N3)) ? 1 : -1];
+
+        public:
+            // the elements, public so that the type stays a plain struct
+            storage_type data_;
+
+            static FRAMEWORK_CONSTEXPR size_t size(const size_t k = 0)
+            {
+                return (k == 0) ? N1 : (k == 1) ? N2 : (k == 2) ? N3 : 0;
+            }
+
+            static FRAMEWORK_CONSTEXPR size_t count(void)
+            {
+                return SIZE;
+            }
+
+            inline row_type& operator[] (const size_t idx)
+            {
+                default_access::check(idx, N1, this);
+                return data_[idx];
+            }
+
+            inline const row_type& operator[] (const size_t idx) const
+            {
+                default_access::check(idx, N1, this);
+                return data_[idx];
+            }
+
+            inline row_type& at(const size_t idx)
+            {
+                checked_access::check(idx, N1, this);
+                return data_[idx];
+            }
+
+            inline const row_type& at(const size_t idx) const
+            {
+                checked_access::check(idx, N1, this);
+                return data_[idx];
+            }
+
+            inline T* data(void)
+            {
+                return reinterpret_cast<T*>(&data_);
+            }
+
+            inline const T* data(void) const
+            {
+                return reinterpret_cast<const T*>(&data_);
+            }
+
+            inline array_ref<T, dimension> ref(void)
+            {
+                return make_ref_<T>(data());
+            }
+
+            inline array_ref<const T, dimension> ref(void) const
+            {
+                return make_ref_<const T>(data());
+            }
+
+            inline void fill(const T& v)
+            {
+                fixed_unroll_<SIZE>::apply_value(data(), v, fixed_assign_());
+            }
+
+            inline void assign(const T* p)
+            {
+                fixed_unroll_<SIZE>::apply(data(), p, fixed_assign_());
+            }
+
+            #define FRAMEWORK_FIXED_OP(op, functor)                         \
+            inline fixed_array& operator op (const fixed_array& rhs)        \
+            {                                                               \
+                fixed_unroll_<SIZE>::apply(data(), rhs.data(), functor());  \
+                return *this;                                               \
+            }                                                               \
+                                                                            \
+            inline fixed_array& operator op (const T& v)                    \
+            {                                                               \
+                fixed_unroll_<SIZE>::apply_value(data(), v, functor());     \
+                return *this;                                               \
+            }
+
+            FRAMEWORK_FIXED_OP(+=, fixed_add_)
+            FRAMEWORK_FIXED_OP(-=, fixed_sub_)
+            FRAMEWORK_FIXED_OP(*=, fixed_mul_)
+            FRAMEWORK_FIXED_OP(/=, fixed_div_)
+
+            #undef FRAMEWORK_FIXED_OP
+
+        private:
+            template <typename U>
+            inline array_ref<U, dimension> make_ref_(U* p) const
+            {
+                size_t ext[3] = { N1, N2, N3 }, stride[3];
+                stride[dimension-1] = 1;
+                for (size_t k = dimension-1; k > 0; k--)
+                    stride[k-1] = stride[k] * ext[k];
+                return array_ref<U, dimension>(p, ext, stride);
+            }
+
+    }; // class fixed_array<T, N1, N2, N3>
+
+    // element-wise arithmetic, * as well like between arrays
+
+    #define FRAMEWORK_FIXED_BINARY(op)                                      \
+    template <typename T, size_t N1, size_t N2, size_t N3>                  \
+    inline fixed_array<T, N1, N2, N3>                                       \
+    operator op (const fixed_array<T, N1, N2, N3>& a,                       \
+                 const fixed_array<T, N1, N2, N3>& b)                       \
+    {                                                                       \
+        fixed_array<T, N1, N2, N3> r = a;                                   \
+        return r op##= b;                                                   \
+    }                                                                       \
+                                                                            \
+    template <typename T, size_t N1, size_t N2, size_t N3>                  \
+    inline fixed_array<T, N1, N2, N3>                                       \
+    operator op (const fixed_array<T, N1, N2, N3>& a, const T& v)           \
+    {                                                                       \
+        fixed_array<T, N1, N2, N3> r = a;                                   \
+        return r op##= v;                                                   \
+    }
+
+    FRAMEWORK_FIXED_BINARY(+)
+    FRAMEWORK_FIXED_BINARY(-)
+    FRAMEWORK_FIXED_BINARY(*)
+    FRAMEWORK_FIXED_BINARY(/)
+
+    #undef FRAMEWORK_FIXED_BINARY
+
+    template <typename T, size_t N1, size_t N2, size_t N3>
+    inline fixed_array<T, N1, N2, N3> operator* (const T& v, const fixed_array<T, N1, N2, N3>& a)
+    {
+        return a * v;
+    }
+
+    template <typename T, size_t N1, size_t N2, size_t N3>
+    inline fixed_array<T, N1, N2, N3> operator- (const fixed_array<T, N1, N2, N3>& a)
+    {
+        fixed_array<T, N1, N2, N3> r;
+        r.fill(T());
+        return r -= a;
+    }
+
+    template <typename T, size_t N1, size_t N2, size_t N3>
+    inline bool operator== (const fixed_array<T, N1, N2, N3>& a, const fixed_array<T, N1, N2, N3>& b)
+    {
+        for (size_t i = 0; i < a.count(); i++)
+            if (!(a.data()[i] == b.data()[i]))
+                return false;
+        return true;
+    }
+
+    template <typename T, size_t N1, size_t N2, size_t N3>
+    inline bool operator!= (const fixed_array<T, N1, N2, N3>& a, const fixed_array<T, N1, N2, N3>& b)
+    {
+        return !(a == b);
+    }
+
+    // matrix product and transpose of the 2-d ones, the loops have
+    // constant trip counts and are unrolled by the compiler
+    template <typename T, size_t M, size_t K, size_t N>
+    inline fixed_array<T, M, N> matmul(const fixed_array<T, M, K>& a, const fixed_array<T, K, N>& b)
+    {
+        fixed_array<T, M, N> c;
+        for (size_t i = 0; i < M; i++) {
+            for (size_t j = 0; j < N; j++)
+                c.data_[i][j] = a.data_[i][0] * b.data_[0][j];
+            for (size_t k = 1; k < K; k++)
+                for (size_t j = 0; j < N; j++)
+                    c.data_[i][j] += a.data_[i][k] * b.data_[k][j];
+        }
+        return c;
+    }
+
+    template <typename T, size_t M, size_t N>
+    inline fixed_array<T, N, M> transpose(const fixed_array<T, M, N>& a)
+    {
+        fixed_array<T, N, M> t;
+        for (size_t i = 0; i < M; i++)
+            for (size_t j = 0; j < N; j++)
+                t.data_[j][i] = a.data_[i][j];
+        return t;
+    }
+
+    template <typename T, size_t N1, size_t N2, size_t N3>
+    inline void write_text(text_writer& w, const fixed_array<T, N1, N2, N3>& a)
+    {
+        write_text(w, a.ref());
+    }
+
+    template <typename T, size_t N1, size_t N2, size_t N3>
+    inline std::ostream& operator<< (std::ostream& os, const fixed_array<T, N1, N2, N3>& a)
+    {
+        return print(os, a);
+    }
+
+} // namespace framework
+
+#endif // __FIXED_H__
@@ -0,0 +1,348 @@
+//
+// format.h
+//
+// bulk text formatter writing elements straight into a streambuf
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __FORMAT_H__
+#define __FORMAT_H__
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <locale>
+#include <vector>
+
+namespace framework
+{
+    // separators and overrides of the stream format. a negative width or
+    // precision and a zero fill take the value of the stream.
+    struct text_format
+    {
+        const char*     sep_;       // after each element
+        const char*     rows_;      // after each sub-array
+        std::streamsize width_;
+        std::streamsize precision_;
+        char            fill_;
+
+        text_format(const char* sep = " ", const char* rows = "\n")
+            : sep_(sep), rows_(rows), width_(-1), precision_(-1), fill_(0) {}
+
+        inline text_format& separator(const char* s)    { sep_ = s; return *this; }
+        inline text_format& rows(const char* s)         { rows_ = s; return *this; }
+        inline text_format& width(std::streamsize w)    { width_ = w; return *this; }
+        inline text_format& precision(std::streamsize p) { precision_ = p; return *this; }
+        inline text_format& fill(char c)                { fill_ = c; return *this; }
+
+    }; // struct text_format
+
+    // how an element is converted, the character types stay with the
+    // stream since it prints them as characters
+    template <typename T> struct text_kind      { enum { value = 0 }; };
+    template <> struct text_kind<short>          { enum { value = 1 }; };
+    template <> struct text_kind<int>            { enum { value = 1 }; };
+    template <> struct text_kind<long>           { enum { value = 1 }; };
+    template <> struct text_kind<long long>      { enum { value = 1 }; };
+    template <> struct text_kind<unsigned short> { enum { value = 2 }; };
+    template <> struct text_kind<unsigned int>   { enum { value = 2 }; };
+    template <> struct text_kind<unsigned long>  { enum { value = 2 }; };
+    template <> struct text_kind<unsigned long long> { enum { value = 2 }; };
+    template <> struct text_kind<float>          { enum { value = 3 }; };
+    template <> struct text_kind<double>         { enum { value = 3 }; };
+    template <> struct text_kind<long double>    { enum { value = 4 }; };
+
+    // formats elements with the width, fill, precision and flags the stream
+    // has on construction, i.e. the same way `os << e` does for each of
+    // them, into a fixed buffer flushed to the streambuf of os. the width
+    // of the stream is reset on destruction like any other insertion.
+    class text_writer
+    {
+        private:
+            enum { CAPACITY = 8192, NUMBER = 64 };
+
+            std::ostream&           os_;
+            std::ostream::sentry    sentry_;
+            std::streambuf*         sb_;
+            const text_format&      fmt_;
+            std::streamsize         width_;
+            std::streamsize         prec_;
+            char                    fill_;
+            std::ios_base::fmtflags flags_;
+            bool                    fast_;      // dec, classic locale
+            char                    ffmt_[8];   // printf format of floats
+            char                    lfmt_[8];   // of long doubles
+            std::ostringstream*     slow_;
+            size_t                  pos_;
+            char                    buf_[CAPACITY];
+
+            // not copyable, it holds the pending output
+            text_writer(const text_writer&);
+            text_writer& operator= (const text_writer&);
+
+        public:
+            text_writer(std::ostream& os, const text_format& f = text_format())
+                : os_(os), sentry_(os), sb_(os.rdbuf()), fmt_(f), slow_(NULL), pos_(0)
+            {
+                width_ = (f.width_ < 0) ? os.width() : f.width_;
+                prec_  = (f.precision_ < 0) ? os.precision() : f.precision_;
+                fill_  = f.fill_ ? f.fill_ : os.fill();
+                flags_ = os.flags();
+
+                std::ios_base::fmtflags base  = flags_ & std::ios_base::basefield;
+                std::ios_base::fmtflags float_ = flags_ & std::ios_base::floatfield;
+                fast_ = ((base == std::ios_base::dec) || !base)
+                     && (float_ != (std::ios_base::fixed | std::ios_base::scientific))
+                     && (os.getloc() == std::locale::classic());
+
+                char conv = (float_ == std::ios_base::fixed) ? 'f'
+                          : (float_ == std::ios_base::scientific) ? 'e' : 'g';
+                if (flags_ & std::ios_base::uppercase)
+                    conv = static_cast<char>(conv - 'a' + 'A');
+                char* p = ffmt_;
+                *p++ = '%';
+                if (flags_ & std::ios_base::showpos)   *p++ = '+';
+                if (flags_ & std::ios_base::showpoint) *p++ = '#';
+                *p++ = '.';
+                *p++ = '*';
+                std::memcpy(lfmt_, ffmt_, p - ffmt_);
+                lfmt_[p - ffmt_] = 'L';
+                lfmt_[p - ffmt_ + 1] = conv;
+                lfmt_[p - ffmt_ + 2] = '\0';
+                *p++ = conv;
+                *p   = '\0';
+                if (prec_ < 0) prec_ = 6;
+            }
+
+            ~text_writer()
+            {
+                flush();
+                delete slow_;
+                os_.width(0);
+            }
+
+            inline bool good(void) const
+            {
+                return bool(sentry_);
+            }
+
+            template <typename T>
+            inline void put(const T& v)
+            {
+                if (fast_)
+                    put_(v, kind_<text_kind<T>::value>());
+                else
+                    put_stream_(v);
+            }
+
+            inline void separator(void)
+            {
+                write_(fmt_.sep_, std::strlen(fmt_.sep_));
+            }
+
+            inline void row(void)
+            {
+                write_(fmt_.rows_, std::strlen(fmt_.rows_));
+            }
+
+            // an empty (sub-)array is padded to the width like an empty string
+            inline void empty(void)
+            {
+                fill_n_(fill_, static_cast<size_t>(width_ > 0 ? width_ : 0));
+            }
+
+            inline void flush(void)
+            {
+                if (pos_ && sentry_)
+                    if (sb_->sputn(buf_, pos_) != static_cast<std::streamsize>(pos_))
+                        os_.setstate(std::ios_base::badbit);
+                pos_ = 0;
+            }
+
+        private:
+            template <int k> struct kind_ {};
+
+            template <typename T>
+            inline void put_(const T& v, kind_<0>)
+            {
+                put_stream_(v);
+            }
+
+            template <typename T>
+            inline void put_(const T& v, kind_<1>)
+            {
+                put_signed_(static_cast<long long>(v));
+            }
+
+            template <typename T>
+            inline void put_(const T& v, kind_<2>)
+            {
+                put_unsigned_(static_cast<unsigned long long>(v), false);
+            }
+
+            template <typename T>
+            inline void put_(const T& v, kind_<3>)
+            {
+                put_float_(v);
+            }
+
+            template <typename T>
+            inline void put_(const T& v, kind_<4>)
+            {
+                put_float_(v);
+            }
+
+            inline void write_(const char* s, size_t n)
+            {
+                if (n > CAPACITY - pos_) {
+                    flush();
+                    if (n > CAPACITY) {
+                        if (sentry_ && (sb_->sputn(s, n) != static_cast<std::streamsize>(n)))
+                            os_.setstate(std::ios_base::badbit);
+                        return;
+                    }
+                }
+                std::memcpy(buf_ + pos_, s, n);
+                pos_ += n;
+            }
+
+            inline void fill_n_(char c, size_t n)
+            {
+                while (n) {
+                    if (pos_ == CAPACITY) flush();
+                    size_t k = std::min(n, static_cast<size_t>(CAPACITY - pos_));
+                    std::memset(buf_ + pos_, c, k);
+                    pos_ += k;
+                    n    -= k;
+                }
+            }
+
+            // pads the converted text s of n chars, sign chars first in internal
+            inline void emit_(const char* s, size_t n, size_t sign)
+            {
+                size_t w = static_cast<size_t>(width_ > 0 ? width_ : 0);
+                if (n >= w) {
+                    write_(s, n);
+                    return;
+                }
+                std::ios_base::fmtflags adjust = flags_ & std::ios_base::adjustfield;
+                if (adjust == std::ios_base::left) {
+                    write_(s, n);
+                    fill_n_(fill_, w - n);
+                } else if (adjust == std::ios_base::internal) {
+                    write_(s, sign);
+                    fill_n_(fill_, w - n);
+                    write_(s + sign, n - sign);
+                } else {
+                    fill_n_(fill_, w - n);
+                    write_(s, n);
+                }
+            }
+
+            inline void put_unsigned_(unsigned long long v, bool neg)
+            {
+                static const char digits[] =
+                    "0001020304050607080910111213141516171819"
+                    "2021222324252627282930313233343536373839"
+                    "4041424344454647484950515253545556575859"
+                    "6061626364656667686970717273747576777879"
+                    "8081828384858687888990919293949596979899";
+                char s[NUMBER];
+                char* p = s + NUMBER;
+                while (v >= 100) {
+                    unsigned int i = static_cast<unsigned int>(v % 100) * 2;
+                    v /= 100;
+                    *--p = digits[i + 1];
+                    *--p = digits[i];
+                }
+                if (v >= 10) {
+                    *--p = digits[v * 2 + 1];
+                    *--p = digits[v * 2];
+                } else {
+                    *--p = static_cast<char>('0' + v);
+                }
+                size_t sign = 0;
+                if (neg) {
+                    *--p = '-';
+                    sign = 1;
+                }
+                emit_(p, s + NUMBER - p, sign);
+            }
+
+            inline void put_signed_(long long v)
+            {
+                if (v < 0) {
+                    put_unsigned_(0ull - static_cast<unsigned long long>(v), true);
+                } else if (flags_ & std::ios_base::showpos) {
+                    char s[NUMBER];
+                    size_t n = static_cast<size_t>(
+                        std::snprintf(s, NUMBER, "+%llu", static_cast<unsigned long long>(v)));
+                    emit_(s, n, 1);
+                } else {
+                    put_unsigned_(static_cast<unsigned long long>(v), false);
+                }
+            }
+
+            template <typename T>
+            inline void put_float_(const T& v)
+            {
+                char s[NUMBER];
+                const char* f = (text_kind<T>::value == 4) ? lfmt_ : ffmt_;
+                int n = (text_kind<T>::value == 4)
+                      ? std::snprintf(s, NUMBER, f, static_cast<int>(prec_), (long double)v)
+                      : std::snprintf(s, NUMBER, f, static_cast<int>(prec_), (double)v);
+                if (n < 0) {
+                    os_.setstate(std::ios_base::failbit);
+                    return;
+                }
+                if (n < NUMBER) {
+                    emit_(s, n, (s[0] == '-') || (s[0] == '+'));
+                    return;
+                }
+                std::vector<char> big(n + 1);
+                if (text_kind<T>::value == 4)
+                    std::snprintf(&big[0], n + 1, f, static_cast<int>(prec_), (long double)v);
+                else
+                    std::snprintf(&big[0], n + 1, f, static_cast<int>(prec_), (double)v);
+                emit_(&big[0], n, (big[0] == '-') || (big[0] == '+'));
+            }
+
+            // other types, locales and bases go through one reused stream
+            template <typename T>
+            inline void put_stream_(const T& v)
+            {
+                if (!slow_) {
+                    slow_ = new std::ostringstream;
+                    slow_->copyfmt(os_);
+                    slow_->precision(prec_);
+                    slow_->fill(fill_);
+                }
+                slow_->str("");
+                slow_->width(width_);
+                *slow_ << v;
+                const std::string& s = slow_->str();
+                write_(s.data(), s.size());
+            }
+
+    }; // class text_writer
+
+    // writes x with the separators and overrides of f, x is anything with
+    // a write_text(text_writer&, x) overload
+    template <typename X>
+    inline std::ostream& print(std::ostream& os, const X& x, const text_format& f = text_format())
+    {
+        {
+            text_writer w(os, f);
+            if (w.good())
+                write_text(w, x);
+        }
+        return os;
+    }
+
+} // namespace framework
+
+#endif // __FORMAT_H__
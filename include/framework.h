@@ -11,7 +11,22 @@
 #define __FRAMEWORK_H__
 
 #include "logstream.h"
+#include "memory.h"
 #include "array.h"
+#include "expression.h"
+#include "view.h"
 #include "buffer.h"
+#include "mapped.h"
+#include "serialize.h"
+#include "numeric.h"
+#include "parallel.h"
+#include "linalg.h"
+#include "sparse.h"
+#include "spsc.h"
+#include "mpmc.h"
+#include "mirrored.h"
+#include "stats.h"
+#include "shm.h"
+#include "fixed.h"
 
 #endif // __FRAMEWORK_H__
@@ -0,0 +1,518 @@
+//
+// linalg.h
+//
+// blocked gemm, gemv, transpose, lu and cholesky on array<T, 2>
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __LINALG_H__
+#define __LINALG_H__
+
+#include <cmath>
+
+#include "array.h"
+#include "simd.h"
+#include "parallel.h"
+
+namespace framework
+{
+    // a row-major matrix of any strides, i.e. element (i, j) is at
+    // p[i * rs + j * cs]. every kernel works on it, so views such as
+    // transposes and blocks are taken as they are.
+    template <typename T>
+    struct matrix_
+    {
+        T*      p;
+        size_t  m, n, rs, cs;
+
+        inline T& operator() (size_t i, size_t j) const
+        {
+            return p[i * rs + j * cs];
+        }
+
+        inline matrix_<T> sub(size_t i, size_t j, size_t m2, size_t n2) const
+        {
+            matrix_<T> s = { p + i * rs + j * cs, m2, n2, rs, cs };
+            return s;
+        }
+    };
+
+    template <typename T, typename U, typename Access>
+    inline matrix_<T> matrix_of_(const array_ref<U, 2, Access>& r)
+    {
+        matrix_<T> a = { const_cast<T*>(static_cast<const T*>(r.data())),
+                         r.size(0), r.size(1), r.stride(0), r.stride(1) };
+        return a;
+    }
+
+    template <typename T>
+    inline matrix_<T> matrix_of_(const array<T, 2>& ar)
+    {
+        size_t n = ar.size(1);
+        matrix_<T> a = { const_cast<T*>(ar.data()), ar.size(0), n, n, 1 };
+        return a;
+    }
+
+    // register tile of the gemm micro kernel and the cache blocks around
+    // it: a MC x KC block of A stays in L2, a KC x NC panel of B in L3.
+    // a row of the tile is one 32-byte vector, wider ones aren't kept in
+    // registers by the compiler.
+    template <typename T>
+    struct gemm_blocking
+    {
+        enum {
+            MR = 6,
+            NR = (sizeof(T) >= 8) ? 4 : 32 / sizeof(T),
+            KC = 256,
+            MC = MR * 16,
+            NC = NR * 128
+        };
+    };
+
+    // c = alpha * a * b + beta * c on one tile. a and b are packed panels
+    // of MR and NR elements per step, only the mr x nr corner is stored.
+    // the loops are left to the autovectorizer, which keeps acc in
+    // registers only at -O3. built with -O2 the tile runs about 3x slower.
+
+    #define FRAMEWORK_GEMM_KERNEL(suffix, attr)                             \
+    template <typename T>                                                   \
+    attr inline void gemm_kernel_##suffix(size_t kc, const T* a, const T* b, \
+        T* c, size_t rsc, size_t csc, size_t mr, size_t nr, T alpha, T beta) \
+    {                                                                       \
+        enum { MR = gemm_blocking<T>::MR, NR = gemm_blocking<T>::NR };      \
+        T acc[MR][NR];                                                      \
+        for (size_t i = 0; i < MR; i++)                                     \
+            for (size_t j = 0; j < NR; j++)                                 \
+                acc[i][j] = T();                                            \
+        for (size_t p = 0; p < kc; p++, a += MR, b += NR)                   \
+            for (size_t i = 0; i < MR; i++) {                               \
+                const T ai = a[i];                                          \
+                for (size_t j = 0; j < NR; j++)                             \
+                    acc[i][j] += ai * b[j];                                 \
+            }                                                               \
+        for (size_t i = 0; i < mr; i++)                                     \
+            for (size_t j = 0; j < nr; j++) {                               \
+                T& cij = c[i * rsc + j * csc];                              \
+                cij = (beta == T()) ? alpha * acc[i][j]                     \
+                                    : alpha * acc[i][j] + beta * cij;       \
+            }                                                               \
+    }
+
+    FRAMEWORK_GEMM_KERNEL(scalar, )
+#ifdef FRAMEWORK_SIMD_X86
+    FRAMEWORK_GEMM_KERNEL(sse2, FRAMEWORK_TARGET("sse2"))
+    FRAMEWORK_GEMM_KERNEL(avx2, FRAMEWORK_TARGET("avx2"))
+#endif
+
+    #undef FRAMEWORK_GEMM_KERNEL
+
+    // copies rows [i, i + m) of a block of A into MR-row panels, zero padded
+    template <typename T>
+    inline void gemm_pack_a_(const matrix_<T>& a, T* d)
+    {
+        const size_t MR = gemm_blocking<T>::MR;
+        for (size_t i = 0; i < a.m; i += MR) {
+            size_t mr = std::min(MR, a.m - i);
+            for (size_t p = 0; p < a.n; p++, d += MR) {
+                size_t k = 0;
+                for (; k < mr; k++) d[k] = a(i + k, p);
+                for (; k < MR; k++) d[k] = T();
+            }
+        }
+    }
+
+    // copies a block of B into NR-column panels, zero padded
+    template <typename T>
+    inline void gemm_pack_b_(const matrix_<T>& b, T* d)
+    {
+        const size_t NR = gemm_blocking<T>::NR;
+        for (size_t j = 0; j < b.n; j += NR) {
+            size_t nr = std::min(NR, b.n - j);
+            for (size_t p = 0; p < b.m; p++, d += NR) {
+                size_t k = 0;
+                if (b.cs == 1) {
+                    const T* s = &b(p, j);
+                    for (; k < nr; k++) d[k] = s[k];
+                } else {
+                    for (; k < nr; k++) d[k] = b(p, j + k);
+                }
+                for (; k < NR; k++) d[k] = T();
+            }
+        }
+    }
+
+    template <typename T>
+    struct gemm_job_
+    {
+        typedef void (*kernel)(size_t, const T*, const T*, T*, size_t, size_t,
+                               size_t, size_t, T, T);
+
+        matrix_<T>  a, c;
+        const T*    bp;         // packed panel of B
+        T*          ap;         // MC x KC of packing space per block of rows
+        size_t      kc, nc;
+        T           alpha, beta;
+        kernel      k;
+
+        // one MC block of rows of C
+        inline void operator() (size_t blk)
+        {
+            enum { MR = gemm_blocking<T>::MR, NR = gemm_blocking<T>::NR,
+                   MC = gemm_blocking<T>::MC };
+            size_t ic = blk * MC;
+            size_t mc = std::min(static_cast<size_t>(MC), a.m - ic);
+            T* p = ap + ic * kc;
+            gemm_pack_a_(a.sub(ic, 0, mc, kc), p);
+            for (size_t jr = 0; jr < nc; jr += NR)
+                for (size_t ir = 0; ir < mc; ir += MR)
+                    k(kc, p + ir * kc, bp + jr * kc, &c(ic + ir, jr), c.rs, c.cs,
+                      std::min(static_cast<size_t>(MR), mc - ir),
+                      std::min(static_cast<size_t>(NR), nc - jr), alpha, beta);
+        }
+    };
+
+    // c = alpha * a * b + beta * c. the blocks of rows of C are spread
+    // over the thread pool when threaded is set.
+    template <typename T>
+    inline void gemm_(T alpha, const matrix_<T>& a, const matrix_<T>& b, T beta,
+                      const matrix_<T>& c, bool threaded)
+    {
+        enum { MC = gemm_blocking<T>::MC, KC = gemm_blocking<T>::KC,
+               NC = gemm_blocking<T>::NC, NR = gemm_blocking<T>::NR };
+
+        if ((a.n != b.m) || (a.m != c.m) || (b.n != c.n))
+            throw(array_exception(array_exception::DIM_ERROR));
+        if (!c.m || !c.n)
+            return;
+        if (!a.n || (alpha == T())) {
+            for (size_t i = 0; i < c.m; i++)
+                for (size_t j = 0; j < c.n; j++)
+                    c(i, j) = (beta == T()) ? T() : beta * c(i, j);
+            return;
+        }
+
+        gemm_job_<T> job;
+        job.alpha = alpha;
+#ifdef FRAMEWORK_SIMD_X86
+        switch (simd::level()) {
+            case simd::AVX2: job.k = &gemm_kernel_avx2<T>; break;
+            case simd::SSE2: job.k = &gemm_kernel_sse2<T>; break;
+            default:         job.k = &gemm_kernel_scalar<T>; break;
+        }
+#else
+        job.k = &gemm_kernel_scalar<T>;
+#endif
+
+        // one packing space for B and one per block of rows for A, used
+        // by every panel. MC is a multiple of MR, so each block's fits.
+        size_t blocks = (c.m + MC - 1) / MC;
+        size_t bsize  = ((std::min(static_cast<size_t>(NC), c.n) + NR - 1) / NR) * NR * KC;
+        size_t asize  = blocks * MC * std::min(static_cast<size_t>(KC), a.n);
+        T* bp = aligned_new<T>(bsize);
+        T* ap = NULL;
+        try {
+            ap = aligned_new<T>(asize);
+            for (size_t jc = 0; jc < c.n; jc += NC) {
+                size_t nc = std::min(static_cast<size_t>(NC), c.n - jc);
+                for (size_t pc = 0; pc < a.n; pc += KC) {
+                    size_t kc = std::min(static_cast<size_t>(KC), a.n - pc);
+                    gemm_pack_b_(b.sub(pc, jc, kc, nc), bp);
+                    job.a    = a.sub(0, pc, a.m, kc);
+                    job.c    = c.sub(0, jc, c.m, nc);
+                    job.bp   = bp;
+                    job.ap   = ap;
+                    job.kc   = kc;
+                    job.nc   = nc;
+                    job.beta = pc ? T(1) : beta;
+                    if (threaded)
+                        thread_pool::global().run(blocks, job);
+                    else
+                        for (size_t blk = 0; blk < blocks; blk++)
+                            job(blk);
+                }
+            }
+        } catch (...) {
+            if (ap) aligned_delete(ap, asize);
+            aligned_delete(bp, bsize);
+            throw;
+        }
+        aligned_delete(ap, asize);
+        aligned_delete(bp, bsize);
+    }
+
+    // C = alpha * A * B + beta * C, any of them may be a strided view
+    template <typename S, typename T, typename U, typename V,
+              typename A1, typename A2, typename A3>
+    inline void gemm(const S alpha, const array_ref<U, 2, A1>& A,
+                     const array_ref<V, 2, A2>& B, const S beta,
+                     const array_ref<T, 2, A3>& C, bool threaded = true)
+    {
+        gemm_(static_cast<T>(alpha), matrix_of_<T>(A), matrix_of_<T>(B),
+              static_cast<T>(beta), matrix_of_<T>(C), threaded);
+    }
+
+    // an empty C is sized to the product, which it needs when beta is 0
+    template <typename S, typename T>
+    inline void gemm(const S alpha, const array<T, 2>& A, const array<T, 2>& B,
+                     const S beta, array<T, 2>& C, bool threaded = true)
+    {
+        if (!C.size() && A.size() && B.size(1))
+            C.set_size(A.size(0), B.size(1));
+        gemm_(static_cast<T>(alpha), matrix_of_(A), matrix_of_(B),
+              static_cast<T>(beta), matrix_of_(C), threaded);
+    }
+
+    // y = alpha * A * x + beta * y
+    template <typename T>
+    struct gemv_rows_
+    {
+        matrix_<T>  a;
+        const T*    x;
+        T*          y;
+        size_t      incy;
+        T           alpha, beta;
+
+        inline void operator() (size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++) {
+                T t = simd::dot(&a(i, 0), x, a.n);
+                T& yi = y[i * incy];
+                yi = (beta == T()) ? alpha * t : alpha * t + beta * yi;
+            }
+        }
+    };
+
+    template <typename T>
+    inline void gemv_(T alpha, const matrix_<T>& a, const T* x, size_t incx,
+                      T beta, T* y, size_t incy, bool threaded)
+    {
+        if ((a.cs == 1) && (incx == 1)) {
+            gemv_rows_<T> rows = { a, x, y, incy, alpha, beta };
+            if (threaded)
+                parallel_for(a.m, std::max(static_cast<size_t>(1),
+                             FRAMEWORK_PARALLEL_CHUNK / (a.n * sizeof(T) + 1)), rows);
+            else
+                rows(0, a.m);
+            return;
+        }
+        for (size_t i = 0; i < a.m; i++)
+            y[i * incy] = (beta == T()) ? T() : beta * y[i * incy];
+        if ((a.rs == 1) && (incy == 1)) {
+            // columns are contiguous, y gathers them with axpy
+            for (size_t j = 0; j < a.n; j++)
+                simd::axpy(y, alpha * x[j * incx], &a(0, j), a.m);
+            return;
+        }
+        for (size_t i = 0; i < a.m; i++) {
+            T t = T();
+            for (size_t j = 0; j < a.n; j++)
+                t += a(i, j) * x[j * incx];
+            y[i * incy] += alpha * t;
+        }
+    }
+
+    template <typename S, typename T, typename U, typename V,
+              typename A1, typename A2, typename A3>
+    inline void gemv(const S alpha, const array_ref<U, 2, A1>& A,
+                     const array_ref<V, 1, A2>& x, const S beta,
+                     const array_ref<T, 1, A3>& y, bool threaded = true)
+    {
+        if ((A.size(1) != x.size()) || (A.size(0) != y.size()))
+            throw(array_exception(array_exception::DIM_ERROR));
+        gemv_(static_cast<T>(alpha), matrix_of_<T>(A), static_cast<const T*>(x.data()),
+              x.stride(), static_cast<T>(beta), y.data(), y.stride(), threaded);
+    }
+
+    // an empty y is sized to the product, which it needs when beta is 0
+    template <typename S, typename T>
+    inline void gemv(const S alpha, const array<T, 2>& A, const array<T, 1>& x,
+                     const S beta, array<T, 1>& y, bool threaded = true)
+    {
+        if (!y.size() && A.size())
+            y.set_size(A.size(0));
+        if ((A.size(1) != x.size()) || (A.size(0) != y.size()))
+            throw(array_exception(array_exception::DIM_ERROR));
+        gemv_(static_cast<T>(alpha), matrix_of_(A), x.data(), 1,
+              static_cast<T>(beta), y.data(), 1, threaded);
+    }
+
+    // transposes in tiles which fit L1 on both sides
+    enum { TRANSPOSE_TILE = 32 };
+
+    template <typename T>
+    inline void transpose_copy(const array<T, 2>& A, array<T, 2>& At)
+    {
+        size_t m = A.size(0), n = A.size(1);
+        if ((At.size(0) != n) || (At.size(1) != m))
+            At.set_size(n, m);
+        const T* s = A.data();
+        T* d = At.data();
+        for (size_t ii = 0; ii < m; ii += TRANSPOSE_TILE)
+            for (size_t jj = 0; jj < n; jj += TRANSPOSE_TILE) {
+                size_t ie = std::min(ii + TRANSPOSE_TILE, m);
+                size_t je = std::min(jj + TRANSPOSE_TILE, n);
+                for (size_t i = ii; i < ie; i++)
+                    for (size_t j = jj; j < je; j++)
+                        d[j * m + i] = s[i * n + j];
+            }
+    }
+
+    // in place, only square matrices since the block can't change shape
+    template <typename T>
+    inline void transpose_inplace(array<T, 2>& A)
+    {
+        size_t n = A.size(0);
+        if (A.size(1) != n)
+            throw(array_exception(array_exception::DIM_ERROR));
+        T* p = A.data();
+        for (size_t ii = 0; ii < n; ii += TRANSPOSE_TILE)
+            for (size_t jj = ii; jj < n; jj += TRANSPOSE_TILE) {
+                size_t ie = std::min(ii + TRANSPOSE_TILE, n);
+                size_t je = std::min(jj + TRANSPOSE_TILE, n);
+                for (size_t i = ii; i < ie; i++)
+                    for (size_t j = (ii == jj) ? i + 1 : jj; j < je; j++)
+                        std::swap(p[i * n + j], p[j * n + i]);
+            }
+    }
+
+    // block size of the factorizations, the trailing update is a gemm
+    enum { FACTOR_BLOCK = 64 };
+
+    // PA = LU with partial pivoting. A is overwritten by L below the
+    // diagonal, its unit diagonal left out, and by U on and above it.
+    // row i of A was row piv[i] of the input.
+    template <typename T>
+    inline void lu(array<T, 2>& A, array<size_t, 1>& piv, bool threaded = true)
+    {
+        size_t n = A.size(0);
+        if (A.size(1) != n)
+            throw(array_exception(array_exception::DIM_ERROR));
+        if (piv.size() != n)
+            piv.set_size(n);
+        matrix_<T> a = matrix_of_(A);
+        size_t* pv = piv.data();
+        for (size_t i = 0; i < n; i++)
+            pv[i] = i;
+
+        for (size_t k = 0; k < n; k += FACTOR_BLOCK) {
+            size_t nb = std::min(static_cast<size_t>(FACTOR_BLOCK), n - k);
+
+            // panel, whole rows are swapped so the rest sees the same order
+            for (size_t j = k; j < k + nb; j++) {
+                size_t p = j;
+                for (size_t i = j + 1; i < n; i++)
+                    if (std::abs(a(i, j)) > std::abs(a(p, j)))
+                        p = i;
+                if (a(p, j) == T())
+                    throw(array_exception(array_exception::SINGULAR));
+                if (p != j) {
+                    std::swap_ranges(&a(j, 0), &a(j, 0) + n, &a(p, 0));
+                    std::swap(pv[j], pv[p]);
+                }
+                T r = T(1) / a(j, j);
+                for (size_t i = j + 1; i < n; i++) {
+                    T l = (a(i, j) *= r);
+                    if (j + 1 < k + nb)
+                        simd::axpy(&a(i, j + 1), -l, &a(j, j + 1), k + nb - j - 1);
+                }
+            }
+            if (k + nb == n)
+                break;
+
+            // U12 = L11^-1 A12
+            size_t rest = n - k - nb;
+            for (size_t i = k + 1; i < k + nb; i++)
+                for (size_t j = k; j < i; j++)
+                    simd::axpy(&a(i, k + nb), -a(i, j), &a(j, k + nb), rest);
+
+            // A22 -= L21 U12
+            gemm_(T(-1), a.sub(k + nb, k, rest, nb), a.sub(k, k + nb, nb, rest),
+                  T(1), a.sub(k + nb, k + nb, rest, rest), threaded);
+        }
+    }
+
+    // solves A x = b with the factors of lu(), b is overwritten by x
+    template <typename T>
+    inline void lu_solve(const array<T, 2>& LU, const array<size_t, 1>& piv, array<T, 1>& b)
+    {
+        size_t n = LU.size(0);
+        if ((piv.size() != n) || (b.size() != n))
+            throw(array_exception(array_exception::DIM_ERROR));
+        matrix_<T> a = matrix_of_(LU);
+        array<T, 1> x(n);
+        for (size_t i = 0; i < n; i++)
+            x.data()[i] = b.data()[piv.data()[i]];
+        T* y = x.data();
+        for (size_t i = 1; i < n; i++)
+            y[i] -= simd::dot(&a(i, 0), y, i);
+        for (size_t i = n; i-- > 0; )
+            y[i] = (y[i] - simd::dot(&a(i, i + 1), y + i + 1, n - i - 1)) / a(i, i);
+        simd::copy(b.data(), y, n);
+    }
+
+    // A = L L^T of a symmetric positive definite A. A is overwritten by L,
+    // its upper triangle is zeroed.
+    template <typename T>
+    inline void cholesky(array<T, 2>& A, bool threaded = true)
+    {
+        size_t n = A.size(0);
+        if (A.size(1) != n)
+            throw(array_exception(array_exception::DIM_ERROR));
+        matrix_<T> a = matrix_of_(A);
+
+        for (size_t k = 0; k < n; k += FACTOR_BLOCK) {
+            size_t nb = std::min(static_cast<size_t>(FACTOR_BLOCK), n - k);
+
+            // L11
+            for (size_t j = k; j < k + nb; j++) {
+                T d = a(j, j) - simd::dot(&a(j, k), &a(j, k), j - k);
+                if (!(d > T()))
+                    throw(array_exception(array_exception::NOT_DEFINITE));
+                d = std::sqrt(d);
+                a(j, j) = d;
+                for (size_t i = j + 1; i < k + nb; i++)
+                    a(i, j) = (a(i, j) - simd::dot(&a(i, k), &a(j, k), j - k)) / d;
+            }
+            if (k + nb == n)
+                break;
+
+            // L21 = A21 L11^-T, row by row
+            size_t rest = n - k - nb;
+            for (size_t i = k + nb; i < n; i++)
+                for (size_t j = k; j < k + nb; j++)
+                    a(i, j) = (a(i, j) - simd::dot(&a(i, k), &a(j, k), j - k)) / a(j, j);
+
+            // A22 -= L21 L21^T, the upper half of it is scratch
+            matrix_<T> l21 = a.sub(k + nb, k, rest, nb), l21t = l21;
+            std::swap(l21t.m, l21t.n);
+            std::swap(l21t.rs, l21t.cs);
+            gemm_(T(-1), l21, l21t, T(1), a.sub(k + nb, k + nb, rest, rest), threaded);
+        }
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = i + 1; j < n; j++)
+                a(i, j) = T();
+    }
+
+    // solves A x = b with L of cholesky(), b is overwritten by x
+    template <typename T>
+    inline void cholesky_solve(const array<T, 2>& L, array<T, 1>& b)
+    {
+        size_t n = L.size(0);
+        if (b.size() != n)
+            throw(array_exception(array_exception::DIM_ERROR));
+        matrix_<T> a = matrix_of_(L);
+        T* y = b.data();
+        for (size_t i = 0; i < n; i++)
+            y[i] = (y[i] - simd::dot(&a(i, 0), y, i)) / a(i, i);
+        for (size_t i = n; i-- > 0; ) {
+            y[i] /= a(i, i);
+            for (size_t j = 0; j < i; j++)
+                y[j] -= a(i, j) * y[i];
+        }
+    }
+
+} // namespace framework
+
+#endif // __LINALG_H__
@@ -14,11 +14,293 @@
 #include <fstream>
 #include <streambuf>
 #include <cstdarg>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "mpmc.h"
 
 namespace framework {
 
+    // what an asynchronous logstream does when every block is in flight
+    enum log_overflow
+    {
+        LOG_BLOCK,      // waits for the writer thread to return one
+        LOG_DROP        // drops the bytes and counts them
+    };
+
+    // logstreams in asynchronous mode and every mt_logstream register
+    // here, so a process leaving through exit() still writes out what
+    // they hold
+    class log_exit_hook_
+    {
+        public:
+            virtual ~log_exit_hook_() {}
+            virtual void at_exit_(void) = 0;
+
+        protected:
+            static inline pthread_mutex_t& mutex_(void)
+            {
+                static pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER;
+                return m;
+            }
+
+            // built before the handler is registered, so it outlives it
+            static inline std::vector<log_exit_hook_*>& hooks_(void)
+            {
+                static std::vector<log_exit_hook_*> v;
+                return v;
+            }
+
+            static inline void run_hooks_(void)
+            {
+                std::vector<log_exit_hook_*> v;
+                {
+                    scoped_lock_ lk(&mutex_());
+                    v = hooks_();
+                }
+                for (size_t i = 0; i < v.size(); i++)
+                    v[i]->at_exit_();
+            }
+
+            inline void hook_(void)
+            {
+                static bool registered = false;
+                scoped_lock_ lk(&mutex_());
+                hooks_().push_back(this);
+                if (!registered) {
+                    registered = true;
+                    std::atexit(log_exit_);
+                }
+            }
+
+            inline void unhook_(void)
+            {
+                scoped_lock_ lk(&mutex_());
+                std::vector<log_exit_hook_*>& v = hooks_();
+                v.erase(std::remove(v.begin(), v.end(), this), v.end());
+            }
+
+        private:
+            static void log_exit_(void)
+            {
+                run_hooks_();
+            }
+
+    }; // class log_exit_hook_
+
+    // the background side of an asynchronous logstream. the stream fills
+    // preallocated blocks and publishes what it wrote through a lock-free
+    // queue, a thread writes it to the sinks each block was meant for and
+    // syncs the sinks once per batch, then returns the blocks it's done
+    // with through a second queue. a block is in the queue at most once:
+    // what's added while it waits goes out with it, so records gather in
+    // a block while the writer is busy and never wait for the next one.
     template <class charT, class traits = std::char_traits<charT> >
-    class basic_logstreambuf : public std::basic_streambuf<charT, traits>
+    class basic_log_writer
+    {
+        public:
+            typedef std::basic_streambuf<charT, traits> streambuf_type;
+
+            // called by the writer thread before it sleeps, false to be
+            // called again soon
+            typedef bool (*idle_hook)(void* arg, basic_log_writer& w);
+
+            enum { HELD = 1, QUEUED = 2 };
+
+            struct block
+            {
+                charT*          data;
+                std::streamsize n;          // published so far
+                std::streamsize done;       // written out, by the writer thread
+                unsigned        sinks;      // bit 0 for sbuf1, bit 1 for sbuf2
+                unsigned        state;      // HELD by the caller, QUEUED for the writer
+                bool            heap;       // from make_heap, not the pool
+            };
+
+        private:
+            streambuf_type*     sbuf_[2];
+            std::vector<block>  blocks_;
+            std::vector<charT>  chars_;
+            mpmc_queue<block*>  ready_;     // NULL stops the thread
+            mpmc_queue<block*>  free_;
+            size_t              block_size_;
+            idle_hook           idle_;
+            void*               idle_arg_;
+            pthread_t           thread_;
+            bool                running_;
+
+            basic_log_writer(const basic_log_writer&);
+            basic_log_writer& operator= (const basic_log_writer&);
+
+            static void* run_(void* arg)
+            {
+                static_cast<basic_log_writer*>(arg)->drain_();
+                return NULL;
+            }
+
+            inline void recycle_(block* b)
+            {
+                if (b->heap) {
+                    delete[] b->data;
+                    delete b;
+                    return;
+                }
+                b->n = b->done = 0;
+                b->state = HELD;
+                free_.push(b);
+            }
+
+            // next block, after the idle hook if there's none
+            inline block* next_(void)
+            {
+                block* b;
+                if (ready_.try_pop(b))
+                    return b;
+                while (idle_ && !idle_(idle_arg_, *this))
+                    if (ready_.pop_for(b, 0.001))
+                        return b;
+                ready_.pop(b);
+                return b;
+            }
+
+            inline void drain_(void)
+            {
+                for (bool stop = false; !stop; ) {
+                    block* b = next_();
+                    unsigned used = 0;
+                    do {
+                        if (!b) {
+                            stop = true;
+                            continue;
+                        }
+                        // unqueued first, what's published after goes
+                        // through the queue again
+                        unsigned s = __atomic_fetch_and(&b->state, ~static_cast<unsigned>(QUEUED),
+                                                        __ATOMIC_ACQ_REL);
+                        std::streamsize n = __atomic_load_n(&b->n, __ATOMIC_ACQUIRE);
+                        if (n > b->done) {
+                            for (int k = 0; k < 2; k++)
+                                if (b->sinks & (1u << k))
+                                    sbuf_[k]->sputn(b->data + b->done, n - b->done);
+                            used |= b->sinks;
+                            b->done = n;
+                        }
+                        if (!(s & HELD))
+                            recycle_(b);
+                    } while (ready_.try_pop(b));
+                    for (int k = 0; k < 2; k++)
+                        if (used & (1u << k))
+                            sbuf_[k]->pubsync();
+                }
+            }
+
+            inline void publish_(block* b, std::streamsize n, unsigned state)
+            {
+                __atomic_store_n(&b->n, n, __ATOMIC_RELEASE);
+                if (!(__atomic_exchange_n(&b->state, state, __ATOMIC_ACQ_REL) & QUEUED))
+                    ready_.push(b);
+            }
+
+        public:
+            basic_log_writer(streambuf_type* sbuf1, streambuf_type* sbuf2, size_t blocks, size_t block_size,
+                             idle_hook idle = NULL, void* idle_arg = NULL)
+                : blocks_(blocks ? blocks : 1), chars_(blocks_.size() * block_size),
+                  ready_(blocks_.size() + 1), free_(std::max(blocks_.size(), static_cast<size_t>(2))),
+                  block_size_(block_size), idle_(idle), idle_arg_(idle_arg), running_(false)
+            {
+                sbuf_[0] = sbuf1;
+                sbuf_[1] = sbuf2;
+                for (size_t i = 0; i < blocks_.size(); i++) {
+                    blocks_[i].data  = &chars_[i * block_size];
+                    blocks_[i].n     = 0;
+                    blocks_[i].done  = 0;
+                    blocks_[i].sinks = 0;
+                    blocks_[i].state = HELD;
+                    blocks_[i].heap  = false;
+                    free_.push(&blocks_[i]);
+                }
+                if (pthread_create(&thread_, NULL, run_, this))
+                    throw(array_exception(array_exception::IO_ERROR));
+                running_ = true;
+            }
+
+            ~basic_log_writer()
+            {
+                stop();
+            }
+
+            // a free block, held by the caller, or NULL if none is and
+            // wait is false
+            inline block* acquire(bool wait)
+            {
+                block* b = NULL;
+                if (wait)
+                    free_.pop(b);
+                else
+                    free_.try_pop(b);
+                return b;
+            }
+
+            // capacity of a pooled block
+            inline size_t block_size(void) const
+            {
+                return block_size_;
+            }
+
+            // a block of its own for n characters, for what doesn't fit a
+            // pooled one. submit() it, the writer thread deletes it.
+            static inline block* make_heap(size_t n)
+            {
+                block* b = new block;
+                b->data  = new charT[n];
+                b->n     = 0;
+                b->done  = 0;
+                b->sinks = 0;
+                b->state = HELD;
+                b->heap  = true;
+                return b;
+            }
+
+            // the first n characters of b go out soon, the caller keeps
+            // it to add more
+            inline void flush(block* b, std::streamsize n)
+            {
+                publish_(b, n, HELD | QUEUED);
+            }
+
+            // b goes out up to n and comes back, the caller is done with it
+            inline void submit(block* b, std::streamsize n)
+            {
+                publish_(b, n, QUEUED);
+            }
+
+            // for the idle hook: takes back b, held by a caller which
+            // stays off it meanwhile, unless some of it is yet to go out
+            inline bool reclaim(block* b)
+            {
+                if (__atomic_load_n(&b->state, __ATOMIC_ACQUIRE) != HELD)
+                    return false;
+                recycle_(b);
+                return true;
+            }
+
+            // writes out everything submitted and ends the thread
+            inline void stop(void)
+            {
+                if (!running_) return;
+                ready_.push(NULL);
+                pthread_join(thread_, NULL);
+                running_ = false;
+            }
+
+    }; // class basic_log_writer<charT, traits>
+
+    template <class charT, class traits = std::char_traits<charT> >
+    class basic_logstreambuf : public std::basic_streambuf<charT, traits>, private log_exit_hook_
     {
         public:
             typedef charT                               char_type;
@@ -27,6 +309,8 @@ namespace framework {
             typedef typename traits::off_type           off_type;
             typedef traits                              traits_type;
             typedef std::basic_streambuf<charT, traits> streambuf_type;
+            typedef basic_log_writer<charT, traits>     writer_type;
+            typedef typename writer_type::block         block_type;
 
         private:
             streambuf_type  *sbuf1_;
@@ -34,44 +318,145 @@ namespace framework {
             bool            sw1_;
             bool            sw2_;
             char_type       *buf_;
+            writer_type     *writer_;       // set in asynchronous mode
+            block_type      *cur_;          // the put area then, buf_ while NULL
+            log_overflow    policy_;
+            std::streamsize dropped_;
             enum {BUFFER_SIZE = 4096 / sizeof(char_type)};
 
         public:
             basic_logstreambuf(streambuf_type *sbuf1, streambuf_type *sbuf2)
-                : sbuf1_(sbuf1), sbuf2_(sbuf2), buf_(new char_type[BUFFER_SIZE])
+                : sbuf1_(sbuf1), sbuf2_(sbuf2), buf_(new char_type[BUFFER_SIZE]),
+                  writer_(NULL), cur_(NULL), policy_(LOG_BLOCK), dropped_(0)
             {
                 sw1_ = sw2_ = true;
-                setp(buf_, buf_ + BUFFER_SIZE);
+                this->setp(buf_, buf_ + BUFFER_SIZE);
             }
 
             ~basic_logstreambuf()
             {
                 this->pubsync();
+                async_off();
                 delete[] buf_;
             }
 
-            void sbuf1_on(void)  { sync(); sw1_ = true; }
-            void sbuf1_off(void) { sync(); sw1_ = false; }
-            void sbuf2_on(void)  { sync(); sw2_ = true; }
-            void sbuf2_off(void) { sync(); sw2_ = false; }
+            void sbuf1_on(void)  { settle_(); sw1_ = true; }
+            void sbuf1_off(void) { settle_(); sw1_ = false; }
+            void sbuf2_on(void)  { settle_(); sw2_ = true; }
+            void sbuf2_off(void) { settle_(); sw2_ = false; }
+
+            // from now on the put area is one of blocks preallocated
+            // blocks. a sync publishes it to a writer thread, which writes
+            // out what's new each time it comes to it, and the block is
+            // handed over when it's full, so the caller never waits on
+            // the sinks. with LOG_BLOCK it waits when all blocks are in
+            // flight, with LOG_DROP what it writes meanwhile is dropped
+            // and counted in dropped(). the sinks must not be used by
+            // anyone else meanwhile.
+            void async_on(size_t blocks = 64, log_overflow policy = LOG_BLOCK)
+            {
+                sync();
+                async_off();
+                writer_ = new writer_type(sbuf1_, sbuf2_, blocks, BUFFER_SIZE);
+                policy_ = policy;
+                take_(true);
+                hook_();
+            }
+
+            // writes out what is pending, waits for the writer thread to
+            // finish and goes back to synchronous writes
+            void async_off(void)
+            {
+                if (!writer_) return;
+                unhook_();
+                hand_over_();
+                delete writer_;
+                writer_ = NULL;
+                if (sw1_) sbuf1_->pubsync();
+                if (sw2_) sbuf2_->pubsync();
+            }
+
+            bool is_async(void) const
+            {
+                return writer_ != NULL;
+            }
+
+            // characters dropped by LOG_DROP
+            std::streamsize dropped(void) const
+            {
+                return dropped_;
+            }
+
+        private:
+            unsigned sinks_(void) const
+            {
+                return (sw1_ ? 1u : 0u) | (sw2_ ? 2u : 0u);
+            }
+
+            virtual void at_exit_(void)
+            {
+                async_off();
+            }
+
+            // a block for the put area, with what buf_ holds. false if
+            // none is free and wait is false.
+            bool take_(bool wait)
+            {
+                block_type* b = writer_->acquire(wait);
+                if (!b) return false;
+                std::streamsize n = static_cast<std::streamsize>(this->pptr() - this->pbase());
+                traits_type::copy(b->data, buf_, n);
+                b->sinks = sinks_();
+                cur_ = b;
+                this->setp(cur_->data, cur_->data + BUFFER_SIZE);
+                this->pbump(static_cast<int>(n));
+                return true;
+            }
+
+            // hands the put area over, or drops it if there's no block for
+            // it. the put area is buf_ after.
+            void hand_over_(void)
+            {
+                std::streamsize n = static_cast<std::streamsize>(this->pptr() - this->pbase());
+                if (!cur_ && n && !take_(policy_ == LOG_BLOCK))
+                    dropped_ += n;
+                if (cur_)
+                    writer_->submit(cur_, n);
+                cur_ = NULL;
+                this->setp(buf_, buf_ + BUFFER_SIZE);
+            }
+
+            // what's pending goes out with the sinks as they are now
+            void settle_(void)
+            {
+                if (writer_)
+                    hand_over_();
+                else
+                    sync();
+            }
 
         protected:
             virtual int_type overflow(int_type c = traits_type::eof())
             {
-                // empty our buffer into sbuf1_ and sbuf2_
-                std::streamsize n = static_cast<std::streamsize>(this->pptr() - this->pbase());
-                if (sw1_) {
-                    std::streamsize size1 = sbuf1_->sputn(this->pbase(), n);
-                    if (size1 != n) return traits_type::eof();
-                }
-                if (sw2_) {
-                    std::streamsize size2 = sbuf2_->sputn(this->pbase(), n);
-                    if (size2 != n) return traits_type::eof();
+                if (writer_) {
+                    hand_over_();
+                    take_(policy_ == LOG_BLOCK);
+                } else {
+                    // empty our buffer into sbuf1_ and sbuf2_
+                    std::streamsize n = static_cast<std::streamsize>(this->pptr() - this->pbase());
+                    if (sw1_) {
+                        std::streamsize size1 = sbuf1_->sputn(this->pbase(), n);
+                        if (size1 != n) return traits_type::eof();
+                    }
+                    if (sw2_) {
+                        std::streamsize size2 = sbuf2_->sputn(this->pbase(), n);
+                        if (size2 != n) return traits_type::eof();
+                    }
+
+                    // reset our buffer
+                    this->setp(buf_, buf_+BUFFER_SIZE);
                 }
 
-                // reset our buffer
-                setp(buf_, buf_+BUFFER_SIZE);
-
                 // write the passed character if necessary
                 if (!traits_type::eq_int_type(c, traits_type::eof()))
                 {
@@ -84,6 +469,18 @@ namespace framework {
 
             virtual int sync()
             {
+                // the writer thread syncs the sinks after each batch
+                if (writer_) {
+                    std::streamsize n = static_cast<std::streamsize>(this->pptr() - this->pbase());
+                    if (cur_ || (n && take_(policy_ == LOG_BLOCK))) {
+                        writer_->flush(cur_, n);
+                    } else {
+                        dropped_ += n;
+                        this->setp(buf_, buf_ + BUFFER_SIZE);
+                    }
+                    return 0;
+                }
+
                 // flush our buffer into sbuf1_ and sbuf2_
                 int_type c = this->overflow(traits_type::eof());
 
@@ -160,8 +557,11 @@ namespace framework {
                 fbuf_.open(file, std::ios::out);
             }
 
+            // an asynchronous stream is written out and becomes
+            // synchronous again
             virtual void close(void)
             {
+                logbuf_.async_off();
                 base_stream_type::flush();
                 if (fbuf_.is_open()) fbuf_.close();
             }
@@ -171,6 +571,15 @@ namespace framework {
             void cout_on(void)  { logbuf_.sbuf2_on();  }
             void cout_off(void) { logbuf_.sbuf2_off(); }
 
+            // see basic_logstreambuf::async_on, after open()
+            void async(size_t blocks = 64, log_overflow policy = LOG_BLOCK)
+            {
+                base_stream_type::flush();
+                logbuf_.async_on(blocks, policy);
+            }
+
+            std::streamsize dropped(void) const { return logbuf_.dropped(); }
+
             int printf(const char *fmt, ...)
             {
                 va_list argptr;
@@ -190,6 +599,401 @@ namespace framework {
     typedef basic_logstream<char>       logstream;
     typedef basic_logstream<wchar_t>    wlogstream;
 
+    // where a record_buf commits its records
+    template <class charT, class traits = std::char_traits<charT> >
+    class basic_record_sink
+    {
+        public:
+            virtual ~basic_record_sink() {}
+            virtual void commit(const charT* p, std::streamsize n) = 0;
+
+    }; // class basic_record_sink<charT, traits>
+
+    // put area of one thread. whatever is written between two syncs is
+    // one record, kept together by growing the buffer and committed as a
+    // whole. a record over MAX_RECORD characters is committed in pieces.
+    template <class charT, class traits = std::char_traits<charT> >
+    class basic_record_buf : public std::basic_streambuf<charT, traits>
+    {
+        public:
+            typedef typename traits::int_type           int_type;
+            typedef traits                              traits_type;
+            typedef basic_record_sink<charT, traits>    sink_type;
+
+        private:
+            sink_type*          sink_;
+            std::vector<charT>  buf_;
+            enum {BUFFER_SIZE = 4096 / sizeof(charT), MAX_RECORD = 256 * BUFFER_SIZE};
+
+        public:
+            explicit basic_record_buf(sink_type* sink) : sink_(sink), buf_(BUFFER_SIZE)
+            {
+                this->setp(&buf_[0], &buf_[0] + buf_.size());
+            }
+
+            inline sink_type* sink(void) const
+            {
+                return sink_;
+            }
+
+        protected:
+            virtual int_type overflow(int_type c = traits_type::eof())
+            {
+                std::ptrdiff_t n = this->pptr() - this->pbase();
+                if (buf_.size() < MAX_RECORD) {
+                    buf_.resize(buf_.size() * 2);
+                    this->setp(&buf_[0], &buf_[0] + buf_.size());
+                    this->pbump(static_cast<int>(n));
+                } else {
+                    sync();
+                }
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    traits_type::assign(*this->pptr(), traits_type::to_char_type(c));
+                    this->pbump(1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            virtual int sync()
+            {
+                std::streamsize n = static_cast<std::streamsize>(this->pptr() - this->pbase());
+                if (n)
+                    sink_->commit(this->pbase(), n);
+                this->setp(&buf_[0], &buf_[0] + buf_.size());
+                return 0;
+            }
+
+    }; // class basic_record_buf<charT, traits>
+
+    // logstream for many threads. out() is a stream of the calling
+    // thread's own, formatting touches nothing shared, and each flush
+    // (std::endl, printf) commits what the thread wrote since as one
+    // record, so lines never interleave. a commit writes to the sinks
+    // under a lock, or after async() copies the record into a block of
+    // the writer thread with no lock at all. each thread gathers its
+    // records in a block of its own while the writer is busy, which the
+    // writer takes back when it's idle.
+    //
+    // open, close, async and the switches are for when no other thread
+    // is logging, as is destroying it. exit() writes out the records of
+    // every thread, in either mode, and commits what they wrote without
+    // a flush yet, which needs the other threads not to be logging then.
+    template <class charT, class traits = std::char_traits<charT> >
+    class basic_mt_logstream : public basic_record_sink<charT, traits>, private log_exit_hook_
+    {
+        public:
+            typedef std::basic_ostream<charT, traits>   ostream_type;
+            typedef std::basic_streambuf<charT, traits> streambuf_type;
+            typedef basic_record_buf<charT, traits>     record_buf_type;
+            typedef basic_log_writer<charT, traits>     writer_type;
+            typedef typename writer_type::block         block_type;
+
+        private:
+            struct local_ : public basic_record_sink<charT, traits>
+            {
+                basic_mt_logstream* owner;
+                block_type*         cur;        // records gathered in asynchronous mode
+                int                 busy;       // cur is in use, spun on
+                record_buf_type     buf;
+                ostream_type        os;
+
+                explicit local_(basic_mt_logstream* o) : owner(o), cur(NULL), busy(0), buf(this), os(&buf) {}
+
+                virtual void commit(const charT* p, std::streamsize n)
+                {
+                    owner->commit_(this, p, n);
+                }
+            };
+
+            friend struct local_;
+
+            std::basic_filebuf<charT, traits>   fbuf_;
+            streambuf_type*                     sbuf_[2];
+            bool                                sw_[2];
+            pthread_mutex_t                     m_;         // the sinks in synchronous mode
+            pthread_mutex_t                     list_m_;
+            pthread_key_t                       key_;
+            std::vector<local_*>                locals_;
+            writer_type*                        writer_;
+            log_overflow                        policy_;
+            std::streamsize                     dropped_;
+            enum {BLOCK_SIZE = 4096 / sizeof(charT)};
+
+            basic_mt_logstream(const basic_mt_logstream&);
+            basic_mt_logstream& operator= (const basic_mt_logstream&);
+
+            inline void init_(void)
+            {
+                sbuf_[0] = &fbuf_;
+                sbuf_[1] = std::cout.rdbuf();
+                sw_[0] = sw_[1] = true;
+                writer_  = NULL;
+                policy_  = LOG_BLOCK;
+                dropped_ = 0;
+                pthread_mutex_init(&m_, NULL);
+                pthread_mutex_init(&list_m_, NULL);
+                pthread_key_create(&key_, &basic_mt_logstream::exit_thread_);
+                hook_();
+            }
+
+            // at the exit of a thread which logged
+            static void exit_thread_(void* p)
+            {
+                local_* l = static_cast<local_*>(p);
+                l->os.flush();
+                l->owner->hand_over_(l);
+                l->owner->forget_(l);
+            }
+
+            inline void forget_(local_* l)
+            {
+                {
+                    scoped_lock_ lk(&list_m_);
+                    locals_.erase(std::remove(locals_.begin(), locals_.end(), l), locals_.end());
+                }
+                delete l;
+            }
+
+            inline unsigned sinks_(void) const
+            {
+                return (__atomic_load_n(&sw_[0], __ATOMIC_RELAXED) ? 1u : 0u)
+                     | (__atomic_load_n(&sw_[1], __ATOMIC_RELAXED) ? 2u : 0u);
+            }
+
+            inline void set_(int k, bool on)
+            {
+                flush_all_();
+                scoped_lock_ lk(&m_);
+                __atomic_store_n(&sw_[k], on, __ATOMIC_RELAXED);
+            }
+
+            inline void flush_all_(void)
+            {
+                scoped_lock_ lk(&list_m_);
+                for (size_t i = 0; i < locals_.size(); i++) {
+                    locals_[i]->os.flush();
+                    hand_over_(locals_[i]);
+                }
+            }
+
+            static inline bool try_lock_(local_* l)
+            {
+                int free = 0;
+                return __atomic_compare_exchange_n(&l->busy, &free, 1, false,
+                                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+            }
+
+            static inline void lock_(local_* l)
+            {
+                while (!try_lock_(l))
+                    sched_yield();
+            }
+
+            static inline void unlock_(local_* l)
+            {
+                __atomic_store_n(&l->busy, 0, __ATOMIC_RELEASE);
+            }
+
+            inline void hand_over_(local_* l)
+            {
+                lock_(l);
+                if (l->cur) {
+                    writer_->submit(l->cur, l->cur->n);
+                    l->cur = NULL;
+                }
+                unlock_(l);
+            }
+
+            // the writer thread's idle hook: takes back the blocks of the
+            // threads which aren't committing, so none is kept by a thread
+            // which stopped logging
+            static bool reclaim_(void* arg, writer_type& w)
+            {
+                basic_mt_logstream* s = static_cast<basic_mt_logstream*>(arg);
+                if (pthread_mutex_trylock(&s->list_m_))
+                    return false;
+                for (size_t i = 0; i < s->locals_.size(); i++) {
+                    local_* l = s->locals_[i];
+                    if (!try_lock_(l)) continue;
+                    if (l->cur && w.reclaim(l->cur))
+                        l->cur = NULL;
+                    unlock_(l);
+                }
+                pthread_mutex_unlock(&s->list_m_);
+                return true;
+            }
+
+            // a record of l joins its block, which is flushed to the
+            // writer and handed over when the next record doesn't fit or
+            // the sinks changed
+            inline void commit_(local_* l, const charT* p, std::streamsize n)
+            {
+                unsigned sinks = sinks_();
+                if (!sinks) return;
+                if (writer_) {
+                    size_t size = writer_->block_size();
+                    if (l) lock_(l);
+                    block_type* b = l ? l->cur : NULL;
+                    if (b && ((b->sinks != sinks) || (static_cast<size_t>(b->n + n) > size))) {
+                        writer_->submit(b, b->n);
+                        b = l->cur = NULL;
+                    }
+                    if (!b) {
+                        b = (static_cast<size_t>(n) > size)
+                          ? writer_type::make_heap(n)
+                          : writer_->acquire(policy_ == LOG_BLOCK);
+                        if (!b) {
+                            if (l) unlock_(l);
+                            __atomic_add_fetch(&dropped_, n, __ATOMIC_RELAXED);
+                            return;
+                        }
+                        b->sinks = sinks;
+                    }
+                    traits::copy(b->data + b->n, p, n);
+                    if (l && !b->heap) {
+                        l->cur = b;
+                        writer_->flush(b, b->n + n);
+                    } else {
+                        writer_->submit(b, b->n + n);
+                    }
+                    if (l) unlock_(l);
+                    return;
+                }
+                scoped_lock_ lk(&m_);
+                for (int k = 0; k < 2; k++) {
+                    if (sinks & (1u << k)) {
+                        sbuf_[k]->sputn(p, n);
+                        sbuf_[k]->pubsync();
+                    }
+                }
+            }
+
+            virtual void at_exit_(void)
+            {
+                flush_all_();
+                async_off();
+            }
+
+        public:
+            basic_mt_logstream()
+            {
+                init_();
+            }
+
+            explicit basic_mt_logstream(const char* file)
+            {
+                init_();
+                open(file);
+            }
+
+            virtual ~basic_mt_logstream()
+            {
+                unhook_();
+                close();
+                pthread_key_delete(key_);
+                for (size_t i = 0; i < locals_.size(); i++)
+                    delete locals_[i];
+                pthread_mutex_destroy(&list_m_);
+                pthread_mutex_destroy(&m_);
+            }
+
+            virtual void open(const char* file)
+            {
+                fbuf_.open(file, std::ios::out);
+            }
+
+            // commits what every thread has pending and writes it out
+            virtual void close(void)
+            {
+                flush_all_();
+                async_off();
+                sbuf_[1]->pubsync();
+                if (fbuf_.is_open()) fbuf_.close();
+            }
+
+            // the stream of the calling thread
+            inline ostream_type& out(void)
+            {
+                local_* l = static_cast<local_*>(pthread_getspecific(key_));
+                if (!l) {
+                    l = new local_(this);
+                    {
+                        scoped_lock_ lk(&list_m_);
+                        locals_.push_back(l);
+                    }
+                    pthread_setspecific(key_, l);
+                }
+                return l->os;
+            }
+
+            template <typename X>
+            inline ostream_type& operator<< (const X& x)
+            {
+                return out() << x;
+            }
+
+            inline ostream_type& operator<< (ostream_type& (*f)(ostream_type&))
+            {
+                return out() << f;
+            }
+
+            void fout_on(void)  { set_(0, true);  }
+            void fout_off(void) { set_(0, false); }
+            void cout_on(void)  { set_(1, true);  }
+            void cout_off(void) { set_(1, false); }
+
+            // records go to a writer thread from now on, see
+            // basic_logstreambuf::async_on
+            void async(size_t blocks = 256, log_overflow policy = LOG_BLOCK)
+            {
+                flush_all_();
+                async_off();
+                policy_ = policy;
+                writer_ = new writer_type(sbuf_[0], sbuf_[1], blocks, BLOCK_SIZE, reclaim_, this);
+            }
+
+            // writes out the blocks of every thread and goes back to
+            // synchronous writes
+            void async_off(void)
+            {
+                if (!writer_) return;
+                flush_all_();
+                delete writer_;
+                writer_ = NULL;
+            }
+
+            // characters dropped by LOG_DROP
+            std::streamsize dropped(void) const
+            {
+                return __atomic_load_n(&dropped_, __ATOMIC_RELAXED);
+            }
+
+            // one record, whole, in a block of its own
+            virtual void commit(const charT* p, std::streamsize n)
+            {
+                commit_(NULL, p, n);
+            }
+
+            // one record
+            int printf(const char *fmt, ...)
+            {
+                va_list argptr;
+                va_start(argptr, fmt);
+
+                int ret;
+                char sr[1024];
+                ret = vsnprintf(sr, 1024, fmt, argptr);
+                out() << sr << std::flush;
+
+                va_end(argptr);
+                return ret;
+            }
+
+    }; // class basic_mt_logstream
+
+    typedef basic_mt_logstream<char>    mt_logstream;
+    typedef basic_mt_logstream<wchar_t> wmt_logstream;
+
 }; // namespace framework
 
 #endif // __LOGSTREAM_H__
@@ -0,0 +1,250 @@
+//
+// mapped.h
+//
+// memory-mapped file and array class template backed by it
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __MAPPED_H__
+#define __MAPPED_H__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "array.h"
+
+namespace framework
+{
+    class mapped_file
+    {
+        public:
+            enum mode {
+                READ_ONLY,      // read-only mapping of an existing file
+                READ_WRITE      // shared mapping, the file is created or grown
+            };
+
+            enum advice {
+                NORMAL      = MADV_NORMAL,
+                SEQUENTIAL  = MADV_SEQUENTIAL,
+                RANDOM      = MADV_RANDOM,
+                WILLNEED    = MADV_WILLNEED
+            };
+
+        private:
+            void*   addr_;      // start of the mapping, page aligned
+            size_t  len_;       // length of the mapping
+            char*   data_;      // the requested offset inside the mapping
+            size_t  sz_;        // requested bytes
+            mode    mode_;
+
+            // not copyable, the mapping has a single owner
+            mapped_file(const mapped_file&);
+            mapped_file& operator= (const mapped_file&);
+
+        public:
+            mapped_file() : addr_(NULL), len_(0), data_(NULL), sz_(0), mode_(READ_ONLY) {}
+
+            mapped_file(const char* path, mode m, size_t bytes = 0, size_t offset = 0)
+                : addr_(NULL), len_(0), data_(NULL), sz_(0), mode_(READ_ONLY)
+            {
+                open(path, m, bytes, offset);
+            }
+
+            ~mapped_file()
+            {
+                close();
+            }
+
+            // maps bytes from offset, or up to the end of the file if bytes is 0
+            inline void open(const char* path, mode m, size_t bytes = 0, size_t offset = 0)
+            {
+                close();
+                int fd = (m == READ_ONLY) ? ::open(path, O_RDONLY)
+                                          : ::open(path, O_RDWR | O_CREAT, 0644);
+                if (fd < 0)
+                    throw(array_exception(array_exception::IO_ERROR));
+
+                struct stat st;
+                if (::fstat(fd, &st) < 0) {
+                    ::close(fd);
+                    throw(array_exception(array_exception::IO_ERROR));
+                }
+                size_t fsize = static_cast<size_t>(st.st_size);
+                if (!bytes)
+                    bytes = (fsize > offset) ? fsize - offset : 0;
+                if (fsize < offset + bytes) {
+                    if ((m == READ_ONLY) || (::ftruncate(fd, offset + bytes) < 0)) {
+                        ::close(fd);
+                        throw(array_exception(array_exception::IO_ERROR));
+                    }
+                }
+
+                size_t page  = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+                size_t base  = offset & ~(page - 1);
+                size_t len   = bytes + (offset - base);
+                void*  addr  = NULL;
+                if (len) {
+                    int prot = (m == READ_ONLY) ? PROT_READ : (PROT_READ | PROT_WRITE);
+                    addr = ::mmap(NULL, len, prot, MAP_SHARED, fd, base);
+                }
+                ::close(fd);
+                if (addr == MAP_FAILED)
+                    throw(array_exception(array_exception::IO_ERROR));
+
+                addr_ = addr;
+                len_  = len;
+                data_ = static_cast<char*>(addr) + (offset - base);
+                sz_   = bytes;
+                mode_ = m;
+            }
+
+            inline void close(void)
+            {
+                if (addr_)
+                    ::munmap(addr_, len_);
+                addr_ = NULL;
+                len_  = 0;
+                data_ = NULL;
+                sz_   = 0;
+            }
+
+            // writes the dirty pages of a READ_WRITE mapping back to the file
+            inline void sync(void)
+            {
+                if (addr_ && (mode_ == READ_WRITE))
+                    if (::msync(addr_, len_, MS_SYNC) < 0)
+                        throw(array_exception(array_exception::IO_ERROR));
+            }
+
+            inline void advise(advice a)
+            {
+                if (addr_)
+                    ::madvise(addr_, len_, a);
+            }
+
+            inline bool is_open(void) const
+            {
+                return addr_ != NULL;
+            }
+
+            inline void* data(void) const
+            {
+                return data_;
+            }
+
+            inline size_t size(void) const
+            {
+                return sz_;
+            }
+
+            inline mode get_mode(void) const
+            {
+                return mode_;
+            }
+
+    }; // class mapped_file
+
+    // array whose block is a mapping of a file holding the elements in
+    // row-major order. pages are loaded lazily on access and a READ_WRITE
+    // mapping is shared with every other process mapping the same file.
+    // writing into a READ_ONLY mapping raises SIGSEGV. T must be a type
+    // which can be stored as raw bytes.
+    template <typename T, size_t dim>
+    class mapped_array : public array<T, dim>
+    {
+        private:
+            mapped_file file_;
+
+        public:
+            mapped_array() : array<T, dim>() {}
+
+            mapped_array(const char* path, mapped_file::mode m, size_t s1)
+                : array<T, dim>()
+            {
+                if (dim != 1)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t ext[] = { s1 };
+                map(path, m, ext);
+            }
+
+            mapped_array(const char* path, mapped_file::mode m, size_t s1, size_t s2)
+                : array<T, dim>()
+            {
+                if (dim != 2)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t ext[] = { s1, s2 };
+                map(path, m, ext);
+            }
+
+            mapped_array(const char* path, mapped_file::mode m, size_t s1, size_t s2, size_t s3)
+                : array<T, dim>()
+            {
+                if (dim != 3)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t ext[] = { s1, s2, s3 };
+                map(path, m, ext);
+            }
+
+            virtual ~mapped_array()
+            {
+                clear();
+            }
+
+            // ext holds dim extents. a 1-d array of extent 0 takes the
+            // whole file from offset.
+            inline void map(const char* path, mapped_file::mode m,
+                            const size_t* ext, size_t offset = 0)
+            {
+                size_t n = 1, e[dim];
+                for (size_t k = 0; k < dim; k++) {
+                    e[k] = ext[k];
+                    n   *= ext[k];
+                }
+                clear();
+                if ((dim == 1) && !n) {
+                    file_.open(path, m, 0, offset);
+                    e[0] = file_.size() / sizeof(T);
+                } else {
+                    file_.open(path, m, n * sizeof(T), offset);
+                }
+                this->attach_(static_cast<T*>(file_.data()), e);
+            }
+
+            inline virtual void clear()
+            {
+                array<T, dim>::clear();
+                file_.close();
+            }
+
+            inline void sync(void)
+            {
+                file_.sync();
+            }
+
+            inline void advise(mapped_file::advice a)
+            {
+                file_.advise(a);
+            }
+
+            inline mapped_file& file(void)
+            {
+                return file_;
+            }
+
+            // stores into the mapped elements, the shape has to match
+            template <typename T2>
+            inline mapped_array<T, dim>& operator= (const array<T2, dim>& rhs)
+            {
+                array<T, dim>::operator= (rhs);
+                return *this;
+            }
+
+    }; // class mapped_array<T, dim>
+
+} // namespace framework
+
+#endif // __MAPPED_H__
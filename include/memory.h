@@ -0,0 +1,339 @@
+//
+// memory.h
+//
+// memory resources for array storage: heap, huge pages, arena and pool
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __MEMORY_H__
+#define __MEMORY_H__
+
+#include <cstddef>
+#include <new>
+
+// huge_page_resource needs anonymous mappings
+#if defined(__unix__) || defined(__APPLE__)
+#define FRAMEWORK_POSIX_MMAN
+#include <sys/mman.h>
+#endif
+
+#if __cplusplus >= 201103L
+#define FRAMEWORK_THREAD_LOCAL      thread_local
+#else
+#define FRAMEWORK_THREAD_LOCAL      __thread
+#endif
+
+namespace framework
+{
+    // source of raw storage. an array takes the default resource of its
+    // thread when constructed and gives its storage back to the same one.
+    class memory_resource
+    {
+        public:
+            virtual ~memory_resource() {}
+
+            // align is a power of two, the result is never NULL
+            virtual void* allocate(size_t bytes, size_t align) = 0;
+            virtual void  deallocate(void* p, size_t bytes, size_t align) = 0;
+
+        protected:
+            static inline size_t round_up_(size_t v, size_t align)
+            {
+                return (v + align - 1) & ~(align - 1);
+            }
+
+    }; // class memory_resource
+
+    // global operator new, aligned by over-allocating. thread-safe.
+    class heap_resource : public memory_resource
+    {
+        public:
+            virtual void* allocate(size_t bytes, size_t align)
+            {
+                void* raw = ::operator new(bytes + sizeof(void*) + align);
+                size_t addr = round_up_(reinterpret_cast<size_t>(raw) + sizeof(void*), align);
+                reinterpret_cast<void**>(addr)[-1] = raw;
+                return reinterpret_cast<void*>(addr);
+            }
+
+            virtual void deallocate(void* p, size_t, size_t)
+            {
+                if (p) ::operator delete(static_cast<void**>(p)[-1]);
+            }
+
+            static inline heap_resource& global(void)
+            {
+                static heap_resource heap;
+                return heap;
+            }
+
+    }; // class heap_resource
+
+#ifdef FRAMEWORK_POSIX_MMAN
+    // anonymous mappings aligned to 2MB and advised to use transparent
+    // huge pages, for blocks large enough to be worth a TLB entry each.
+    // thread-safe.
+    class huge_page_resource : public memory_resource
+    {
+        public:
+            enum { HUGE_PAGE = 2 * 1024 * 1024 };
+
+            virtual void* allocate(size_t bytes, size_t align)
+            {
+                if (align < HUGE_PAGE) align = HUGE_PAGE;
+                size_t len = round_up_(bytes ? bytes : 1, HUGE_PAGE);
+                char* raw = static_cast<char*>(::mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+                                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                if (raw == MAP_FAILED)
+                    throw std::bad_alloc();
+                char* p = reinterpret_cast<char*>(round_up_(reinterpret_cast<size_t>(raw), align));
+                if (p > raw)
+                    ::munmap(raw, p - raw);
+                if (raw + len + align > p + len)
+                    ::munmap(p + len, raw + len + align - (p + len));
+#ifdef MADV_HUGEPAGE
+                ::madvise(p, len, MADV_HUGEPAGE);
+#endif
+                return p;
+            }
+
+            virtual void deallocate(void* p, size_t bytes, size_t)
+            {
+                if (p) ::munmap(p, round_up_(bytes ? bytes : 1, HUGE_PAGE));
+            }
+
+            static inline huge_page_resource& global(void)
+            {
+                static huge_page_resource huge;
+                return huge;
+            }
+
+    }; // class huge_page_resource
+#endif
+
+    // monotonic arena. allocations bump a pointer through chunks taken
+    // from upstream, deallocate does nothing and reset() frees everything
+    // at once. not synchronized, use one arena per thread.
+    class arena_resource : public memory_resource
+    {
+        private:
+            struct chunk_
+            {
+                chunk_* next;
+                size_t  bytes;
+            };
+
+            memory_resource*    up_;
+            size_t              align_;     // least alignment of every block
+            size_t              next_;      // bytes of the next chunk
+            chunk_*             head_;      // the newest chunk
+            char*               cur_;
+            char*               end_;
+
+            // not copyable, the chunks belong to it
+            arena_resource(const arena_resource&);
+            arena_resource& operator= (const arena_resource&);
+
+            inline void grow_(size_t bytes, size_t align)
+            {
+                size_t hdr = round_up_(sizeof(chunk_), align);
+                size_t n   = next_;
+                if (n < hdr + bytes) n = hdr + bytes;
+                chunk_* c = static_cast<chunk_*>(up_->allocate(n, align));
+                c->next  = head_;
+                c->bytes = n;
+                head_ = c;
+                cur_  = reinterpret_cast<char*>(c) + hdr;
+                end_  = reinterpret_cast<char*>(c) + n;
+                next_ = n * 2;
+            }
+
+        public:
+            explicit arena_resource(size_t chunk = 1 << 20, size_t align = 64,
+                                    memory_resource* upstream = &heap_resource::global())
+                : up_(upstream), align_(align), next_(chunk), head_(NULL), cur_(NULL), end_(NULL) {}
+
+            virtual ~arena_resource()
+            {
+                release();
+            }
+
+            virtual void* allocate(size_t bytes, size_t align)
+            {
+                if (align < align_) align = align_;
+                char* p = reinterpret_cast<char*>(round_up_(reinterpret_cast<size_t>(cur_), align));
+                if (!cur_ || (p + bytes > end_)) {
+                    grow_(bytes, align);
+                    p = reinterpret_cast<char*>(round_up_(reinterpret_cast<size_t>(cur_), align));
+                }
+                cur_ = p + bytes;
+                return p;
+            }
+
+            virtual void deallocate(void*, size_t, size_t) {}
+
+            // drops every allocation, the newest chunk is kept for reuse
+            inline void reset(void)
+            {
+                if (!head_) return;
+                chunk_* keep = head_;
+                head_ = head_->next;
+                release();
+                keep->next = NULL;
+                head_ = keep;
+                cur_  = reinterpret_cast<char*>(keep) + round_up_(sizeof(chunk_), align_);
+                end_  = reinterpret_cast<char*>(keep) + keep->bytes;
+            }
+
+            // gives every chunk back to upstream
+            inline void release(void)
+            {
+                while (head_) {
+                    chunk_* c = head_;
+                    head_ = c->next;
+                    up_->deallocate(c, c->bytes, align_);
+                }
+                cur_ = end_ = NULL;
+            }
+
+    }; // class arena_resource
+
+    // free lists of power-of-two size classes from 64 bytes to 64KB,
+    // carved from chunks taken from upstream. larger or more aligned
+    // blocks go to upstream directly. not synchronized, use one per thread.
+    class pool_resource : public memory_resource
+    {
+        private:
+            enum { MIN_CLASS = 64, CLASSES = 11, BLOCKS = 16 };
+
+            struct chunk_
+            {
+                chunk_* next;
+                size_t  bytes;
+            };
+
+            memory_resource*    up_;
+            void*               free_[CLASSES];
+            chunk_*             chunks_;
+
+            pool_resource(const pool_resource&);
+            pool_resource& operator= (const pool_resource&);
+
+            static inline int class_(size_t bytes, size_t align)
+            {
+                if (align > MIN_CLASS) return -1;
+                int c = 0;
+                for (size_t s = MIN_CLASS; s < bytes; s <<= 1)
+                    if (++c == CLASSES) return -1;
+                return c;
+            }
+
+            inline void refill_(int c)
+            {
+                size_t size = static_cast<size_t>(MIN_CLASS) << c;
+                size_t n    = MIN_CLASS + size * BLOCKS;
+                chunk_* k = static_cast<chunk_*>(up_->allocate(n, MIN_CLASS));
+                k->next  = chunks_;
+                k->bytes = n;
+                chunks_  = k;
+                char* p = reinterpret_cast<char*>(k) + MIN_CLASS;
+                for (size_t i = 0; i < BLOCKS; i++, p += size) {
+                    *reinterpret_cast<void**>(p) = free_[c];
+                    free_[c] = p;
+                }
+            }
+
+        public:
+            explicit pool_resource(memory_resource* upstream = &heap_resource::global())
+                : up_(upstream), chunks_(NULL)
+            {
+                for (int c = 0; c < CLASSES; c++)
+                    free_[c] = NULL;
+            }
+
+            virtual ~pool_resource()
+            {
+                release();
+            }
+
+            virtual void* allocate(size_t bytes, size_t align)
+            {
+                int c = class_(bytes, align);
+                if (c < 0)
+                    return up_->allocate(bytes, align);
+                if (!free_[c])
+                    refill_(c);
+                void* p  = free_[c];
+                free_[c] = *static_cast<void**>(p);
+                return p;
+            }
+
+            virtual void deallocate(void* p, size_t bytes, size_t align)
+            {
+                if (!p) return;
+                int c = class_(bytes, align);
+                if (c < 0) {
+                    up_->deallocate(p, bytes, align);
+                    return;
+                }
+                *static_cast<void**>(p) = free_[c];
+                free_[c] = p;
+            }
+
+            // gives every chunk back to upstream, the blocks taken from
+            // upstream directly have to be deallocated before
+            inline void release(void)
+            {
+                while (chunks_) {
+                    chunk_* k = chunks_;
+                    chunks_ = k->next;
+                    up_->deallocate(k, k->bytes, MIN_CLASS);
+                }
+                for (int c = 0; c < CLASSES; c++)
+                    free_[c] = NULL;
+            }
+
+    }; // class pool_resource
+
+    inline memory_resource*& default_resource_(void)
+    {
+        static FRAMEWORK_THREAD_LOCAL memory_resource* mr = NULL;
+        return mr;
+    }
+
+    // resource of the arrays constructed by this thread
+    inline memory_resource* default_resource(void)
+    {
+        memory_resource* mr = default_resource_();
+        return mr ? mr : &heap_resource::global();
+    }
+
+    // returns the previous one, NULL restores the heap
+    inline memory_resource* set_default_resource(memory_resource* mr)
+    {
+        memory_resource* old = default_resource();
+        default_resource_() = mr;
+        return old;
+    }
+
+    // makes mr the default of this thread for the lifetime of the scope,
+    // e.g. around one request whose arrays all come from an arena
+    class resource_scope
+    {
+        private:
+            memory_resource* old_;
+
+            resource_scope(const resource_scope&);
+            resource_scope& operator= (const resource_scope&);
+
+        public:
+            explicit resource_scope(memory_resource* mr) : old_(set_default_resource(mr)) {}
+            ~resource_scope() { set_default_resource(old_); }
+
+    }; // class resource_scope
+
+} // namespace framework
+
+#endif // __MEMORY_H__
@@ -0,0 +1,231 @@
+//
+// mirrored.h
+//
+// ring buffer whose storage is mapped twice back to back, so that the
+// occupied elements are always one contiguous range
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __MIRRORED_H__
+#define __MIRRORED_H__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "array.h"
+#include "buffer.h"
+
+namespace framework
+{
+    // bytes of anonymous shared memory (memfd) mapped at [addr, addr + len)
+    // and again at [addr + len, addr + 2 * len), so a write through either
+    // half shows in the other. len is a multiple of the page size.
+    class mirrored_memory
+    {
+        private:
+            void*   addr_;
+            size_t  len_;
+
+            mirrored_memory(const mirrored_memory&);
+            mirrored_memory& operator= (const mirrored_memory&);
+
+        public:
+            mirrored_memory() : addr_(NULL), len_(0) {}
+
+            explicit mirrored_memory(size_t bytes) : addr_(NULL), len_(0)
+            {
+                open(bytes);
+            }
+
+            ~mirrored_memory()
+            {
+                close();
+            }
+
+            static inline size_t page_size(void)
+            {
+                return static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            }
+
+            // bytes is rounded up to whole pages, the memory is zeroed
+            inline void open(size_t bytes)
+            {
+                close();
+                size_t page = page_size();
+                size_t len  = (bytes + page - 1) & ~(page - 1);
+                if (!len) return;
+
+                int fd = ::memfd_create("framework-mirrored", MFD_CLOEXEC);
+                if (fd < 0)
+                    throw(array_exception(array_exception::IO_ERROR));
+                if (::ftruncate(fd, len) < 0) {
+                    ::close(fd);
+                    throw(array_exception(array_exception::IO_ERROR));
+                }
+
+                // reserves both halves first so nothing else lands in between
+                char* base = static_cast<char*>(::mmap(NULL, 2 * len, PROT_NONE,
+                                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                if (base == MAP_FAILED) {
+                    ::close(fd);
+                    throw(array_exception(array_exception::IO_ERROR));
+                }
+                for (size_t k = 0; k < 2; k++) {
+                    if (::mmap(base + k * len, len, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                        ::munmap(base, 2 * len);
+                        ::close(fd);
+                        throw(array_exception(array_exception::IO_ERROR));
+                    }
+                }
+                ::close(fd);
+                addr_ = base;
+                len_  = len;
+            }
+
+            inline void close(void)
+            {
+                if (addr_)
+                    ::munmap(addr_, 2 * len_);
+                addr_ = NULL;
+                len_  = 0;
+            }
+
+            inline void* data(void) const
+            {
+                return addr_;
+            }
+
+            // of one half
+            inline size_t size(void) const
+            {
+                return len_;
+            }
+
+    }; // class mirrored_memory
+
+    // buffer on mirrored_memory. element i of the storage is also at
+    // i + capacity, so the occupied elements start at window() and run
+    // contiguously for occupied() elements, and peek() and prepare()
+    // return a single run. the capacity is rounded up until it fills
+    // whole pages. T must be a type which can be stored as raw bytes.
+    template <typename T>
+    class mirrored_buffer : public buffer<T>
+    {
+        using array<T, 1>::element_;
+        using array<T, 1>::sz_;
+        using array<T, 1>::tpos_;
+
+        private:
+            mirrored_memory map_;
+
+            // the storage has to stay mapped twice, it can't be swapped for
+            // a heap block
+            using buffer<T>::reserve;
+
+        public:
+            mirrored_buffer() : buffer<T>() {}
+
+            explicit mirrored_buffer(size_t s1) : buffer<T>()
+            {
+                set_size(s1);
+            }
+
+            virtual ~mirrored_buffer()
+            {
+                clear();
+            }
+
+            // elements per page multiple
+            static inline size_t granularity(void)
+            {
+                size_t a = mirrored_memory::page_size(), b = sizeof(T);
+                while (b) {
+                    size_t r = a % b;
+                    a = b;
+                    b = r;
+                }
+                return mirrored_memory::page_size() / a;
+            }
+
+            inline void set_size(size_t s1)
+            {
+                clear();
+                size_t g = granularity();
+                size_t n = (s1 + g - 1) / g * g;
+                map_.open(n * sizeof(T));
+                size_t ext[] = { n };
+                this->attach_(static_cast<T*>(map_.data()), ext);
+            }
+
+            inline void resize(size_t s1)
+            {
+                set_size(s1);
+            }
+
+            inline virtual void clear()
+            {
+                buffer<T>::clear();
+                map_.close();
+            }
+
+            // GROW is not available, see reserve
+            inline void set_policy(full_policy p)
+            {
+                if (p == GROW)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                buffer<T>::set_policy(p);
+            }
+
+            // without the wrap, the mirror covers it
+            inline virtual T& operator[] (size_t idx)
+            {
+                if (idx >= this->occupied())
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                return element_[this->head() + idx];
+            }
+
+            inline virtual const T& operator[] (size_t idx) const
+            {
+                if (idx >= this->occupied())
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                return element_[this->head() + idx];
+            }
+
+            // the oldest element, followed by the others in order
+            inline T* window(void)
+            {
+                return element_ + this->head();
+            }
+
+            inline const T* window(void) const
+            {
+                return element_ + this->head();
+            }
+
+            inline buffer_span<T> peek(void)
+            {
+                buffer_span<T> r = { window(), this->occupied(), element_, 0 };
+                return r;
+            }
+
+            inline buffer_span<const T> peek(void) const
+            {
+                buffer_span<const T> r = { window(), this->occupied(), element_, 0 };
+                return r;
+            }
+
+            inline buffer_span<T> prepare(void)
+            {
+                buffer_span<T> r = { element_ + tpos_, sz_ - this->occupied(), element_, 0 };
+                return r;
+            }
+
+    }; // class mirrored_buffer<T>
+
+} // namespace framework
+
+#endif // __MIRRORED_H__
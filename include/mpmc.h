@@ -0,0 +1,302 @@
+//
+// mpmc.h
+//
+// bounded multi-producer/multi-consumer queue
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __MPMC_H__
+#define __MPMC_H__
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "array.h"
+#include "memory.h"
+#include "parallel.h"
+
+namespace framework
+{
+    // bounded queue for any number of producer and consumer threads, on a
+    // ring of slots which carry a sequence number each (D. Vyukov). a
+    // thread claims a position with one compare-and-swap on the shared
+    // index and then only touches its slot, whose sequence tells whether
+    // it holds an element of this lap. the capacity is exact and at least
+    // 2, with one slot a filled one reads as free for the next lap. a
+    // power of two turns the slot lookup into a mask.
+    //
+    // try_push/try_pop never wait. push/pop spin a little and then sleep
+    // on a condition variable until the queue has room or elements, the
+    // timed ones give up after the timeout. the lock-free paths only take
+    // the mutex to wake a thread when one sleeps.
+    template <typename T>
+    class mpmc_queue
+    {
+        private:
+            enum { LINE = 2 * ARRAY_ALIGNMENT, SPIN = 128 };
+
+            struct cell_
+            {
+                size_t  seq;
+                T       data;
+            };
+
+            struct shared_
+            {
+                cell_*              cells;
+                size_t              cap;
+                size_t              mask;       // cap - 1 for a power of two, else 0
+                memory_resource*    mem;
+                char                pad[LINE - 4 * sizeof(void*)];
+            };
+
+            struct index_
+            {
+                size_t              pos;
+                char                pad[LINE - sizeof(size_t)];
+            };
+
+            shared_         s_;
+            index_          enq_;
+            index_          deq_;
+            size_t          push_waiters_;
+            size_t          pop_waiters_;
+            pthread_mutex_t m_;
+            pthread_cond_t  not_full_;
+            pthread_cond_t  not_empty_;
+
+            // not copyable, threads wait on it
+            mpmc_queue(const mpmc_queue&);
+            mpmc_queue& operator= (const mpmc_queue&);
+
+            inline cell_& cell_at_(size_t pos) const
+            {
+                return s_.cells[s_.mask ? (pos & s_.mask) : (pos % s_.cap)];
+            }
+
+            inline bool enqueue_(const T& e)
+            {
+                size_t pos = __atomic_load_n(&enq_.pos, __ATOMIC_RELAXED);
+                cell_* c;
+                for (;;) {
+                    c = &cell_at_(pos);
+                    size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+                    std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq - pos);
+                    if (dif == 0) {
+                        if (__atomic_compare_exchange_n(&enq_.pos, &pos, pos + 1, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                            break;
+                    } else if (dif < 0) {
+                        return false;       // a lap behind, full
+                    } else {
+                        pos = __atomic_load_n(&enq_.pos, __ATOMIC_RELAXED);
+                    }
+                }
+                c->data = e;
+                __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            inline bool dequeue_(T& e)
+            {
+                size_t pos = __atomic_load_n(&deq_.pos, __ATOMIC_RELAXED);
+                cell_* c;
+                for (;;) {
+                    c = &cell_at_(pos);
+                    size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+                    std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+                    if (dif == 0) {
+                        if (__atomic_compare_exchange_n(&deq_.pos, &pos, pos + 1, true,
+                                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                            break;
+                    } else if (dif < 0) {
+                        return false;       // not written yet, empty
+                    } else {
+                        pos = __atomic_load_n(&deq_.pos, __ATOMIC_RELAXED);
+                    }
+                }
+                // moved out and reset, so the slot holds nothing of it
+                // until it is pushed again
+#ifdef FRAMEWORK_CXX11
+                e = std::move(c->data);
+#else
+                e = c->data;
+#endif
+                c->data = T();
+                __atomic_store_n(&c->seq, pos + s_.cap, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            // the fence pairs with the one of a waiter between counting
+            // itself and trying again, so either it sees the change or the
+            // count is seen here
+            inline void wake_(size_t& waiters, pthread_cond_t& cv)
+            {
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                if (__atomic_load_n(&waiters, __ATOMIC_RELAXED)) {
+                    scoped_lock_ lk(&m_);
+                    pthread_cond_broadcast(&cv);
+                }
+            }
+
+            static inline timespec deadline_(double seconds)
+            {
+                timespec t;
+                clock_gettime(CLOCK_MONOTONIC, &t);
+                if (seconds < 0) seconds = 0;
+                time_t s = static_cast<time_t>(seconds);
+                long ns  = t.tv_nsec + static_cast<long>((seconds - s) * 1e9);
+                t.tv_sec += s + ns / 1000000000L;
+                t.tv_nsec = ns % 1000000000L;
+                return t;
+            }
+
+            // calls op until it succeeds, sleeping on cv in between. false
+            // if the deadline passed first.
+            template <typename Op>
+            inline bool wait_(Op op, size_t& waiters, pthread_cond_t& cv, const timespec* deadline)
+            {
+                for (int i = 0; i < SPIN; i++)
+                    if (op()) return true;
+                scoped_lock_ lk(&m_);
+                __atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                bool ok;
+                while (!(ok = op())) {
+                    if (!deadline)
+                        pthread_cond_wait(&cv, &m_);
+                    else if (pthread_cond_timedwait(&cv, &m_, deadline) == ETIMEDOUT) {
+                        ok = op();
+                        break;
+                    }
+                }
+                __atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+                return ok;
+            }
+
+            struct push_op_
+            {
+                mpmc_queue* q;
+                const T*    e;
+                inline bool operator() () const { return q->enqueue_(*e); }
+            };
+
+            struct pop_op_
+            {
+                mpmc_queue* q;
+                T*          e;
+                inline bool operator() () const { return q->dequeue_(*e); }
+            };
+
+        public:
+            explicit mpmc_queue(size_t capacity)
+            {
+                if (capacity < 2)
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                s_.mem   = default_resource();
+                s_.cells = aligned_new<cell_>(capacity, s_.mem);
+                s_.cap   = capacity;
+                s_.mask  = (capacity & (capacity - 1)) ? 0 : capacity - 1;
+                for (size_t i = 0; i < capacity; i++)
+                    s_.cells[i].seq = i;
+                enq_.pos = deq_.pos = 0;
+                push_waiters_ = pop_waiters_ = 0;
+
+                pthread_condattr_t a;
+                pthread_condattr_init(&a);
+                pthread_condattr_setclock(&a, CLOCK_MONOTONIC);
+                pthread_mutex_init(&m_, NULL);
+                pthread_cond_init(&not_full_, &a);
+                pthread_cond_init(&not_empty_, &a);
+                pthread_condattr_destroy(&a);
+            }
+
+            ~mpmc_queue()
+            {
+                pthread_cond_destroy(&not_empty_);
+                pthread_cond_destroy(&not_full_);
+                pthread_mutex_destroy(&m_);
+                aligned_delete(s_.cells, s_.cap, s_.mem);
+            }
+
+            inline size_t capacity(void) const
+            {
+                return s_.cap;
+            }
+
+            // exact only when no thread is using it
+            inline size_t occupied(void) const
+            {
+                size_t d = __atomic_load_n(&deq_.pos, __ATOMIC_ACQUIRE);
+                size_t e = __atomic_load_n(&enq_.pos, __ATOMIC_ACQUIRE);
+                return (e > d) ? e - d : 0;
+            }
+
+            inline bool empty(void) const
+            {
+                return occupied() == 0;
+            }
+
+            // false if the queue is full
+            inline bool try_push(const T& e)
+            {
+                if (!enqueue_(e))
+                    return false;
+                wake_(pop_waiters_, not_empty_);
+                return true;
+            }
+
+            // false if the queue is empty
+            inline bool try_pop(T& e)
+            {
+                if (!dequeue_(e))
+                    return false;
+                wake_(push_waiters_, not_full_);
+                return true;
+            }
+
+            // waits for room
+            inline void push(const T& e)
+            {
+                push_op_ op = { this, &e };
+                wait_(op, push_waiters_, not_full_, NULL);
+                wake_(pop_waiters_, not_empty_);
+            }
+
+            // waits for an element
+            inline void pop(T& e)
+            {
+                pop_op_ op = { this, &e };
+                wait_(op, pop_waiters_, not_empty_, NULL);
+                wake_(push_waiters_, not_full_);
+            }
+
+            // wait at most the given seconds, false on timeout
+            inline bool push_for(const T& e, double seconds)
+            {
+                push_op_ op = { this, &e };
+                timespec d = deadline_(seconds);
+                if (!wait_(op, push_waiters_, not_full_, &d))
+                    return false;
+                wake_(pop_waiters_, not_empty_);
+                return true;
+            }
+
+            inline bool pop_for(T& e, double seconds)
+            {
+                pop_op_ op = { this, &e };
+                timespec d = deadline_(seconds);
+                if (!wait_(op, pop_waiters_, not_empty_, &d))
+                    return false;
+                wake_(push_waiters_, not_full_);
+                return true;
+            }
+
+    }; // class mpmc_queue<T>
+
+} // namespace framework
+
+#endif // __MPMC_H__
@@ -0,0 +1,117 @@
+//
+// numeric.h
+//
+// fill, reductions and axpy over array and buffer storage
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __NUMERIC_H__
+#define __NUMERIC_H__
+
+#include "array.h"
+#include "buffer.h"
+#include "simd.h"
+
+namespace framework
+{
+    // arrays are reduced over their whole contiguous block
+
+    template <typename T, size_t dim, typename T2>
+    inline void fill(array<T, dim>& ar, const T2 v)
+    {
+        simd::fill(ar.data(), ar.count(), static_cast<T>(v));
+    }
+
+    template <typename T, size_t dim>
+    inline T sum(const array<T, dim>& ar)
+    {
+        return simd::sum(ar.data(), ar.count());
+    }
+
+    template <typename T, size_t dim>
+    inline T min_value(const array<T, dim>& ar)
+    {
+        if (!ar.count())
+            throw(array_exception(array_exception::EMPTY));
+        return simd::min(ar.data(), ar.count());
+    }
+
+    template <typename T, size_t dim>
+    inline T max_value(const array<T, dim>& ar)
+    {
+        if (!ar.count())
+            throw(array_exception(array_exception::EMPTY));
+        return simd::max(ar.data(), ar.count());
+    }
+
+    template <typename T, size_t dim>
+    inline T dot(const array<T, dim>& x, const array<T, dim>& y)
+    {
+        for (size_t k = 0; k < dim; k++)
+            if (x.size(k) != y.size(k))
+                throw(array_exception(array_exception::DIM_ERROR));
+        return simd::dot(x.data(), y.data(), x.count());
+    }
+
+    // y += a * x
+    template <typename T, size_t dim, typename T2>
+    inline void axpy(const T2 a, const array<T, dim>& x, array<T, dim>& y)
+    {
+        for (size_t k = 0; k < dim; k++)
+            if (x.size(k) != y.size(k))
+                throw(array_exception(array_exception::DIM_ERROR));
+        simd::axpy(y.data(), static_cast<T>(a), x.data(), x.count());
+    }
+
+    // buffers are reduced over their occupied elements, which lie in at
+    // most two contiguous segments of the storage
+
+    template <typename T, typename T2>
+    inline void fill(buffer<T>& bf, const T2 v)
+    {
+        size_t n1 = bf.size() - bf.head();
+        if (n1 > bf.occupied()) n1 = bf.occupied();
+        simd::fill(bf.data() + bf.head(), n1, static_cast<T>(v));
+        simd::fill(bf.data(), bf.occupied() - n1, static_cast<T>(v));
+    }
+
+    template <typename T>
+    inline T sum(const buffer<T>& bf)
+    {
+        size_t n1 = bf.size() - bf.head();
+        if (n1 > bf.occupied()) n1 = bf.occupied();
+        return simd::sum(bf.data() + bf.head(), n1)
+             + simd::sum(bf.data(), bf.occupied() - n1);
+    }
+
+    template <typename T>
+    inline T min_value(const buffer<T>& bf)
+    {
+        if (!bf.occupied())
+            throw(array_exception(array_exception::EMPTY));
+        size_t n1 = bf.size() - bf.head();
+        if (n1 >= bf.occupied())
+            return simd::min(bf.data() + bf.head(), bf.occupied());
+        T m1 = simd::min(bf.data() + bf.head(), n1);
+        T m2 = simd::min(bf.data(), bf.occupied() - n1);
+        return (m2 < m1) ? m2 : m1;
+    }
+
+    template <typename T>
+    inline T max_value(const buffer<T>& bf)
+    {
+        if (!bf.occupied())
+            throw(array_exception(array_exception::EMPTY));
+        size_t n1 = bf.size() - bf.head();
+        if (n1 >= bf.occupied())
+            return simd::max(bf.data() + bf.head(), bf.occupied());
+        T m1 = simd::max(bf.data() + bf.head(), n1);
+        T m2 = simd::max(bf.data(), bf.occupied() - n1);
+        return (m1 < m2) ? m2 : m1;
+    }
+
+} // namespace framework
+
+#endif // __NUMERIC_H__
@@ -0,0 +1,431 @@
+//
+// parallel.h
+//
+// work-stealing thread pool and parallel loops over array
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+#include "array.h"
+#include "simd.h"
+
+#ifdef FRAMEWORK_CXX11
+#include <exception>
+#endif
+
+// bytes of one chunk a parallel loop hands to a thread
+#ifndef FRAMEWORK_PARALLEL_CHUNK
+#define FRAMEWORK_PARALLEL_CHUNK    (256 * 1024)
+#endif
+
+namespace framework
+{
+    // pthreads are used instead of <thread> since <tuple> declares
+    // std::array, which collides with array under `using namespace std`
+
+    class scoped_lock_
+    {
+        private:
+            pthread_mutex_t* m_;
+
+            scoped_lock_(const scoped_lock_&);
+            scoped_lock_& operator= (const scoped_lock_&);
+
+        public:
+            explicit scoped_lock_(pthread_mutex_t* m) : m_(m) { pthread_mutex_lock(m_); }
+            ~scoped_lock_() { pthread_mutex_unlock(m_); }
+
+    }; // class scoped_lock_
+
+    // fork-join pool. run() splits the chunks of a loop evenly over the
+    // threads, each thread takes chunks from the front of its own range
+    // and steals from the back of the others when it runs out. the caller
+    // works as thread 0 and a loop started inside a loop runs serially.
+    // an exception thrown by a chunk is rethrown by run(), before c++11
+    // only array_exception is carried over.
+    class thread_pool
+    {
+        private:
+            struct job
+            {
+                virtual ~job() {}
+                virtual void run(size_t w) = 0;
+            };
+
+            // the chunks left to thread w are [lo, hi) of slot w
+            struct slot
+            {
+                pthread_mutex_t m;
+                size_t          lo, hi;
+            };
+
+            template <typename F>
+            struct loop_job : public job
+            {
+                F&                  body_;
+                std::vector<slot>   slots_;
+                pthread_mutex_t     m_;
+                bool                failed_;
+#ifdef FRAMEWORK_CXX11
+                std::exception_ptr  error_;
+#else
+                array_exception     error_;
+#endif
+
+                loop_job(F& body, size_t chunks, size_t threads)
+                    : body_(body), slots_(threads), failed_(false)
+#ifndef FRAMEWORK_CXX11
+                    , error_(array_exception::EMPTY)
+#endif
+                {
+                    pthread_mutex_init(&m_, NULL);
+                    for (size_t w = 0; w < threads; w++) {
+                        pthread_mutex_init(&slots_[w].m, NULL);
+                        slots_[w].lo = chunks * w / threads;
+                        slots_[w].hi = chunks * (w + 1) / threads;
+                    }
+                }
+
+                virtual ~loop_job()
+                {
+                    for (size_t w = 0; w < slots_.size(); w++)
+                        pthread_mutex_destroy(&slots_[w].m);
+                    pthread_mutex_destroy(&m_);
+                }
+
+                inline bool take_(size_t w, size_t& c)
+                {
+                    {
+                        scoped_lock_ lk(&slots_[w].m);
+                        if (slots_[w].lo < slots_[w].hi) {
+                            c = slots_[w].lo++;
+                            return true;
+                        }
+                    }
+                    for (size_t k = 1; k < slots_.size(); k++) {
+                        slot& s = slots_[(w + k) % slots_.size()];
+                        scoped_lock_ lk(&s.m);
+                        if (s.lo < s.hi) {
+                            c = --s.hi;
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+
+                virtual void run(size_t w)
+                {
+                    bool was = inside_();
+                    inside_() = true;
+                    size_t c;
+                    while (take_(w, c)) {
+                        try {
+                            body_(c);
+#ifdef FRAMEWORK_CXX11
+                        } catch (...) {
+                            scoped_lock_ lk(&m_);
+                            if (!failed_) error_ = std::current_exception();
+                            failed_ = true;
+                        }
+#else
+                        } catch (const array_exception& e) {
+                            scoped_lock_ lk(&m_);
+                            if (!failed_) error_ = e;
+                            failed_ = true;
+                        }
+#endif
+                    }
+                    inside_() = was;
+                }
+
+                inline void rethrow(void)
+                {
+                    if (!failed_) return;
+#ifdef FRAMEWORK_CXX11
+                    std::rethrow_exception(error_);
+#else
+                    throw(error_);
+#endif
+                }
+
+            }; // struct loop_job<F>
+
+            std::vector<pthread_t>  threads_;
+            pthread_mutex_t         m_;
+            pthread_mutex_t         run_m_;     // one loop at a time
+            pthread_cond_t          wake_;
+            pthread_cond_t          done_;
+            job*                    job_;
+            size_t                  gen_;
+            size_t                  left_;
+            bool                    stop_;
+
+            // not copyable, the threads belong to it
+            thread_pool(const thread_pool&);
+            thread_pool& operator= (const thread_pool&);
+
+            static inline bool& inside_(void)
+            {
+                static FRAMEWORK_THREAD_LOCAL bool inside = false;
+                return inside;
+            }
+
+            struct start_
+            {
+                thread_pool*    pool;
+                size_t          w;
+            };
+
+            static void* main_(void* arg)
+            {
+                start_ s = *static_cast<start_*>(arg);
+                delete static_cast<start_*>(arg);
+                s.pool->work_(s.w);
+                return NULL;
+            }
+
+            inline void work_(size_t w)
+            {
+                size_t seen = 0;
+                for (;;) {
+                    job* j;
+                    {
+                        scoped_lock_ lk(&m_);
+                        while (!stop_ && (gen_ == seen))
+                            pthread_cond_wait(&wake_, &m_);
+                        if (stop_) return;
+                        seen = gen_;
+                        j    = job_;
+                    }
+                    j->run(w);
+                    scoped_lock_ lk(&m_);
+                    if (--left_ == 0)
+                        pthread_cond_broadcast(&done_);
+                }
+            }
+
+        public:
+            // n threads including the caller, 0 for one per online cpu
+            explicit thread_pool(size_t n = 0)
+                : job_(NULL), gen_(0), left_(0), stop_(false)
+            {
+                pthread_mutex_init(&m_, NULL);
+                pthread_mutex_init(&run_m_, NULL);
+                pthread_cond_init(&wake_, NULL);
+                pthread_cond_init(&done_, NULL);
+                if (!n) {
+                    long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+                    n = (cpus > 0) ? static_cast<size_t>(cpus) : 1;
+                }
+                for (size_t w = 1; w < n; w++) {
+                    start_* s = new start_;
+                    s->pool = this;
+                    s->w    = w;
+                    pthread_t t;
+                    if (pthread_create(&t, NULL, &thread_pool::main_, s)) {
+                        delete s;
+                        break;
+                    }
+                    threads_.push_back(t);
+                }
+            }
+
+            ~thread_pool()
+            {
+                {
+                    scoped_lock_ lk(&m_);
+                    stop_ = true;
+                    pthread_cond_broadcast(&wake_);
+                }
+                for (size_t w = 0; w < threads_.size(); w++)
+                    pthread_join(threads_[w], NULL);
+                pthread_cond_destroy(&done_);
+                pthread_cond_destroy(&wake_);
+                pthread_mutex_destroy(&run_m_);
+                pthread_mutex_destroy(&m_);
+            }
+
+            inline size_t size(void) const
+            {
+                return threads_.size() + 1;
+            }
+
+            // calls body(c) once for every chunk c in [0, chunks) and
+            // returns when all of them are done
+            template <typename F>
+            inline void run(size_t chunks, F body)
+            {
+                if ((chunks < 2) || threads_.empty() || inside_()) {
+                    for (size_t c = 0; c < chunks; c++)
+                        body(c);
+                    return;
+                }
+
+                scoped_lock_ run_lk(&run_m_);
+                loop_job<F> j(body, chunks, size());
+                {
+                    scoped_lock_ lk(&m_);
+                    job_  = &j;
+                    left_ = threads_.size();
+                    gen_++;
+                    pthread_cond_broadcast(&wake_);
+                }
+                j.run(0);
+                {
+                    scoped_lock_ lk(&m_);
+                    while (left_)
+                        pthread_cond_wait(&done_, &m_);
+                    job_ = NULL;
+                }
+                j.rethrow();
+            }
+
+            // the pool the parallel loops use
+            static inline thread_pool& global(void)
+            {
+                static thread_pool pool;
+                return pool;
+            }
+
+    }; // class thread_pool
+
+    // outer indices of ar per chunk, so that a chunk is about
+    // FRAMEWORK_PARALLEL_CHUNK bytes
+    template <typename T, size_t dim>
+    inline size_t parallel_grain_(const array<T, dim>& ar)
+    {
+        size_t row = ar.size() ? ar.count() / ar.size() : 1;
+        size_t g   = FRAMEWORK_PARALLEL_CHUNK / (row * sizeof(T) + 1);
+        return g ? g : 1;
+    }
+
+    // chunk c of a loop over [0, n) in steps of grain, as body(b, e)
+    template <typename F>
+    struct range_body_
+    {
+        F&      body;
+        size_t  n, grain;
+
+        range_body_(F& f, size_t n_, size_t g) : body(f), n(n_), grain(g) {}
+
+        inline void operator() (size_t c)
+        {
+            size_t b = c * grain;
+            body(b, std::min(b + grain, n));
+        }
+    };
+
+    // calls body(b, e) on consecutive ranges covering [0, n), grain
+    // indices each
+    template <typename F>
+    inline void parallel_for(size_t n, size_t grain, F body)
+    {
+        if (!grain) grain = 1;
+        thread_pool::global().run((n + grain - 1) / grain, range_body_<F>(body, n, grain));
+    }
+
+    // calls body(b, e) on ranges [b, e) of the outer indices of ar
+    template <typename T, size_t dim, typename F>
+    inline void parallel_for(array<T, dim>& ar, F body)
+    {
+        parallel_for(ar.size(), parallel_grain_(ar), body);
+    }
+
+    template <typename T>
+    struct fill_body_
+    {
+        T*      p;
+        size_t  row;
+        T       x;
+
+        inline void operator() (size_t b, size_t e)
+        {
+            simd::fill(p + b * row, (e - b) * row, x);
+        }
+    };
+
+    template <typename T, size_t dim, typename T2>
+    inline void parallel_fill(array<T, dim>& ar, const T2 v)
+    {
+        fill_body_<T> f = { ar.data(), ar.size() ? ar.count() / ar.size() : 0,
+                            static_cast<T>(v) };
+        parallel_for(ar, f);
+    }
+
+    template <typename T, typename U, typename F>
+    struct transform_body_
+    {
+        const T*    s;
+        U*          d;
+        size_t      row;
+        F&          f;
+
+        inline void operator() (size_t b, size_t e)
+        {
+            for (size_t i = b * row; i < e * row; i++)
+                d[i] = f(s[i]);
+        }
+    };
+
+    // dst = f(src) element-wise, src and dst may be the same array
+    template <typename T, typename U, size_t dim, typename F>
+    inline void parallel_transform(const array<T, dim>& src, array<U, dim>& dst, F f)
+    {
+        for (size_t k = 0; k < dim; k++)
+            if (src.size(k) != dst.size(k))
+                throw(array_exception(array_exception::DIM_ERROR));
+        transform_body_<T, U, F> t = { src.data(), dst.data(),
+                                       src.size() ? src.count() / src.size() : 0, f };
+        parallel_for(src.size(), parallel_grain_(src), t);
+    }
+
+    template <typename T, typename R, typename Op>
+    struct reduce_body_
+    {
+        const T*        p;
+        size_t          row, n, grain;
+        std::vector<R>& part;
+        Op&             op;
+
+        inline void operator() (size_t c)
+        {
+            size_t b = c * grain * row;
+            size_t e = std::min((c + 1) * grain, n) * row;
+            if (b == e) return;
+            R r = static_cast<R>(p[b]);
+            for (size_t i = b + 1; i < e; i++)
+                r = op(r, p[i]);
+            part[c] = r;
+        }
+    };
+
+    // op(...op(op(init, p0), p1)..., pn) where pc is the left fold of op
+    // over chunk c. the chunks depend on the shape only, so the result is
+    // the same for any number of threads.
+    template <typename T, size_t dim, typename R, typename Op>
+    inline R parallel_reduce(const array<T, dim>& ar, R init, Op op)
+    {
+        if (!ar.count())
+            return init;
+        size_t grain  = parallel_grain_(ar);
+        size_t chunks = (ar.size() + grain - 1) / grain;
+        std::vector<R> part(chunks, init);
+        reduce_body_<T, R, Op> r = { ar.data(), ar.count() / ar.size(), ar.size(),
+                                     grain, part, op };
+        thread_pool::global().run(chunks, r);
+        for (size_t c = 0; c < chunks; c++)
+            init = op(init, part[c]);
+        return init;
+    }
+
+} // namespace framework
+
+#endif // __PARALLEL_H__
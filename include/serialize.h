@@ -0,0 +1,613 @@
+//
+// serialize.h
+//
+// versioned binary format for array and buffer with chunked streaming
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __SERIALIZE_H__
+#define __SERIALIZE_H__
+
+#include <stdint.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+
+#include "array.h"
+#include "buffer.h"
+
+//
+// layout, every field in the byte order given by the endian byte
+//
+//  file header, 64 bytes
+//      0   char[4]     magic "FWAR"
+//      4   uint16      version
+//      6   uint8       endian, 1 little or 2 big
+//      7   uint8       element kind, see binary_header::kind
+//      8   uint32      element size in bytes
+//     12   uint32      dim
+//     16   uint64[3]   extents, the first one is 0 for an open stream
+//     40   uint64      aux, the capacity of a serialized buffer
+//     48   uint8[12]   reserved
+//     60   uint32      crc32c of bytes 0..59
+//
+//  chunk, repeated up to the end of the stream
+//      0   char[4]     magic "FWCK"
+//      4   uint32      crc32c of the payload
+//      8   uint64      number of elements
+//     16   payload
+//
+
+namespace framework
+{
+    // crc32c (castagnoli), with the sse4.2 instruction when available
+
+    // filled by the constructor of a function-local static, whose
+    // initialization is thread-safe (C++11, and g++ in any mode)
+    struct crc32c_table_type_
+    {
+        uint32_t table[256];
+
+        crc32c_table_type_()
+        {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : (c >> 1);
+                table[i] = c;
+            }
+        }
+    };
+
+    inline const uint32_t* crc32c_table_(void)
+    {
+        static const crc32c_table_type_ t;
+        return t.table;
+    }
+
+    inline uint32_t crc32c_scalar_(uint32_t crc, const unsigned char* p, size_t n)
+    {
+        const uint32_t* table = crc32c_table_();
+        for (size_t i = 0; i < n; i++)
+            crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+        return crc;
+    }
+
+#ifdef FRAMEWORK_SIMD_X86
+    FRAMEWORK_TARGET("sse4.2")
+    inline uint32_t crc32c_sse42_(uint32_t crc, const unsigned char* p, size_t n)
+    {
+        for (; n && (reinterpret_cast<size_t>(p) & 7); n--)
+            crc = _mm_crc32_u8(crc, *p++);
+#ifdef __x86_64__
+        uint64_t c = crc;
+        for (; n >= 8; n -= 8, p += 8) {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            c = _mm_crc32_u64(c, v);
+        }
+        crc = static_cast<uint32_t>(c);
+#endif
+        for (; n >= 4; n -= 4, p += 4) {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            crc = _mm_crc32_u32(crc, v);
+        }
+        for (; n; n--)
+            crc = _mm_crc32_u8(crc, *p++);
+        return crc;
+    }
+#endif
+
+    inline uint32_t crc32c(const void* data, size_t n, uint32_t crc = 0)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        crc = ~crc;
+#ifdef FRAMEWORK_SIMD_X86
+        static const bool hw = __builtin_cpu_supports("sse4.2");
+        if (hw)
+            return ~crc32c_sse42_(crc, p, n);
+#endif
+        return ~crc32c_scalar_(crc, p, n);
+    }
+
+    inline void swap_bytes_(void* data, size_t count, size_t esize)
+    {
+        unsigned char* p = static_cast<unsigned char*>(data);
+        if (esize < 2) return;
+        for (size_t i = 0; i < count; i++, p += esize)
+            std::reverse(p, p + esize);
+    }
+
+    // element kind of the arithmetic types, RAW for everything else
+    template <typename T> struct element_kind      { enum { value = 0 }; };
+    template <> struct element_kind<char>           { enum { value = 1 }; };
+    template <> struct element_kind<signed char>    { enum { value = 1 }; };
+    template <> struct element_kind<short>          { enum { value = 1 }; };
+    template <> struct element_kind<int>            { enum { value = 1 }; };
+    template <> struct element_kind<long>           { enum { value = 1 }; };
+    template <> struct element_kind<long long>      { enum { value = 1 }; };
+    template <> struct element_kind<unsigned char>  { enum { value = 2 }; };
+    template <> struct element_kind<unsigned short> { enum { value = 2 }; };
+    template <> struct element_kind<unsigned int>   { enum { value = 2 }; };
+    template <> struct element_kind<unsigned long>  { enum { value = 2 }; };
+    template <> struct element_kind<unsigned long long> { enum { value = 2 }; };
+    template <> struct element_kind<float>          { enum { value = 3 }; };
+    template <> struct element_kind<double>         { enum { value = 3 }; };
+
+    struct binary_header
+    {
+        enum { VERSION = 1, SIZE = 64, CHUNK_SIZE = 16 };
+        enum kind { RAW = 0, SIGNED_INT = 1, UNSIGNED_INT = 2, FLOATING = 3 };
+
+        uint8_t     kind_;
+        uint32_t    esize_;
+        uint32_t    dim_;
+        uint64_t    ext_[3];
+        uint64_t    aux_;
+        bool        swap_;      // written with the other byte order
+
+        binary_header() : kind_(RAW), esize_(0), dim_(0), aux_(0), swap_(false)
+        {
+            ext_[0] = ext_[1] = ext_[2] = 0;
+        }
+
+        template <typename T>
+        static binary_header make(size_t dim, const size_t* ext)
+        {
+            binary_header h;
+            h.kind_  = element_kind<T>::value;
+            h.esize_ = sizeof(T);
+            h.dim_   = static_cast<uint32_t>(dim);
+            for (size_t k = 0; k < dim; k++)
+                h.ext_[k] = ext[k];
+            return h;
+        }
+
+        static inline uint8_t native_endian(void)
+        {
+            const uint16_t one = 1;
+            return (*reinterpret_cast<const uint8_t*>(&one) == 1) ? 1 : 2;
+        }
+
+        template <typename T>
+        inline void check(size_t dim) const
+        {
+            if ((dim_ != dim) || (esize_ != sizeof(T))
+                    || (kind_ != element_kind<T>::value))
+                throw(array_exception(array_exception::DIM_ERROR));
+        }
+
+        // elements in one record, i.e. one step of the first extent
+        inline uint64_t inner(void) const
+        {
+            uint64_t n = 1;
+            for (uint32_t k = 1; k < dim_; k++)
+                n *= ext_[k];
+            return n;
+        }
+
+        inline void write(std::ostream& os) const
+        {
+            char b[SIZE];
+            std::memset(b, 0, SIZE);
+            uint16_t version = VERSION;
+            std::memcpy(b, "FWAR", 4);
+            std::memcpy(b + 4, &version, 2);
+            b[6] = static_cast<char>(native_endian());
+            b[7] = static_cast<char>(kind_);
+            std::memcpy(b + 8, &esize_, 4);
+            std::memcpy(b + 12, &dim_, 4);
+            std::memcpy(b + 16, ext_, 24);
+            std::memcpy(b + 40, &aux_, 8);
+            uint32_t crc = crc32c(b, 60);
+            std::memcpy(b + 60, &crc, 4);
+            if (!os.write(b, SIZE))
+                throw(array_exception(array_exception::IO_ERROR));
+        }
+
+        inline void read(std::istream& is)
+        {
+            char b[SIZE];
+            if (!is.read(b, SIZE) || std::memcmp(b, "FWAR", 4))
+                throw(array_exception(array_exception::IO_ERROR));
+            swap_ = (static_cast<uint8_t>(b[6]) != native_endian());
+            uint16_t version;
+            uint32_t crc;
+            std::memcpy(&version, b + 4, 2);
+            std::memcpy(&crc, b + 60, 4);
+            if (swap_) {
+                swap_bytes_(&version, 1, 2);
+                swap_bytes_(&crc, 1, 4);
+            }
+            if ((version > VERSION) || (crc != crc32c(b, 60)))
+                throw(array_exception(array_exception::IO_ERROR));
+            kind_ = static_cast<uint8_t>(b[7]);
+            std::memcpy(&esize_, b + 8, 4);
+            std::memcpy(&dim_, b + 12, 4);
+            std::memcpy(ext_, b + 16, 24);
+            std::memcpy(&aux_, b + 40, 8);
+            if (swap_) {
+                swap_bytes_(&esize_, 1, 4);
+                swap_bytes_(&dim_, 1, 4);
+                swap_bytes_(ext_, 3, 8);
+                swap_bytes_(&aux_, 1, 8);
+            }
+            if ((dim_ < 1) || (dim_ > 3))
+                throw(array_exception(array_exception::DIM_ERROR));
+        }
+
+        template <typename T>
+        static inline void write_chunk(std::ostream& os, const T* p, size_t n)
+        {
+            char b[CHUNK_SIZE];
+            uint32_t crc   = crc32c(p, n * sizeof(T));
+            uint64_t count = n;
+            std::memcpy(b, "FWCK", 4);
+            std::memcpy(b + 4, &crc, 4);
+            std::memcpy(b + 8, &count, 8);
+            os.write(b, CHUNK_SIZE);
+            if (n) os.write(reinterpret_cast<const char*>(p), n * sizeof(T));
+            if (!os)
+                throw(array_exception(array_exception::IO_ERROR));
+        }
+
+        // reads the next chunk header, false at the end of the stream
+        inline bool read_chunk(std::istream& is, uint64_t& count, uint32_t& crc) const
+        {
+            char b[CHUNK_SIZE];
+            is.read(b, CHUNK_SIZE);
+            if (is.gcount() == 0 && is.eof())
+                return false;
+            if ((is.gcount() != CHUNK_SIZE) || std::memcmp(b, "FWCK", 4))
+                throw(array_exception(array_exception::IO_ERROR));
+            std::memcpy(&crc, b + 4, 4);
+            std::memcpy(&count, b + 8, 8);
+            if (swap_) {
+                swap_bytes_(&crc, 1, 4);
+                swap_bytes_(&count, 1, 8);
+            }
+            // no crc covers the count, a corrupt one mustn't turn into a
+            // huge allocation
+            std::streamoff left = remaining_(is);
+            if ((left >= 0) && esize_ && (count > static_cast<uint64_t>(left) / esize_))
+                throw(array_exception(array_exception::IO_ERROR));
+            return true;
+        }
+
+        // bytes after the read position, -1 if the stream can't seek
+        static inline std::streamoff remaining_(std::istream& is)
+        {
+            std::streampos cur = is.tellg();
+            if (cur == std::streampos(-1))
+                return -1;
+            is.seekg(0, std::ios::end);
+            std::streampos end = is.tellg();
+            is.seekg(cur);
+            return (end == std::streampos(-1)) ? -1 : static_cast<std::streamoff>(end - cur);
+        }
+
+        // reads a payload of n elements, checks it and fixes its byte order
+        template <typename T>
+        inline void read_payload(std::istream& is, T* p, size_t n, uint32_t crc) const
+        {
+            if (n && !is.read(reinterpret_cast<char*>(p), n * sizeof(T)))
+                throw(array_exception(array_exception::IO_ERROR));
+            if (crc != crc32c(p, n * sizeof(T)))
+                throw(array_exception(array_exception::IO_ERROR));
+            if (swap_)
+                swap_bytes_(p, n, sizeof(T));
+        }
+
+    }; // struct binary_header
+
+    // whole arrays and buffers, a header followed by the payload chunks
+
+    // resizes ar to the stored extents unless it already has them
+    template <typename T>
+    inline void reshape_for_(array<T, 1>& ar, const size_t* ext)
+    {
+        if (ar.size() != ext[0]) ar.set_size(ext[0]);
+    }
+
+    template <typename T>
+    inline void reshape_for_(array<T, 2>& ar, const size_t* ext)
+    {
+        if ((ar.size(0) != ext[0]) || (ar.size(1) != ext[1]))
+            ar.set_size(ext[0], ext[1]);
+    }
+
+    template <typename T>
+    inline void reshape_for_(array<T, 3>& ar, const size_t* ext)
+    {
+        if ((ar.size(0) != ext[0]) || (ar.size(1) != ext[1]) || (ar.size(2) != ext[2]))
+            ar.set_size(ext[0], ext[1], ext[2]);
+    }
+
+    template <typename T, size_t dim>
+    inline void serialize(std::ostream& os, const array<T, dim>& ar)
+    {
+        size_t ext[dim];
+        for (size_t k = 0; k < dim; k++)
+            ext[k] = ar.size(k);
+        binary_header::make<T>(dim, ext).write(os);
+        binary_header::write_chunk(os, ar.data(), ar.count());
+    }
+
+    template <typename T, size_t dim>
+    inline void deserialize(std::istream& is, array<T, dim>& ar)
+    {
+        binary_header h;
+        h.read(is);
+        h.check<T>(dim);
+        size_t ext[3] = { static_cast<size_t>(h.ext_[0]),
+                          static_cast<size_t>(h.ext_[1]),
+                          static_cast<size_t>(h.ext_[2]) };
+        reshape_for_(ar, ext);
+        size_t total = ar.count(), got = 0;
+        uint64_t count;
+        uint32_t crc;
+        while ((got < total) && h.read_chunk(is, count, crc)) {
+            if (count > total - got)
+                throw(array_exception(array_exception::IO_ERROR));
+            h.read_payload(is, ar.data() + got, static_cast<size_t>(count), crc);
+            got += static_cast<size_t>(count);
+        }
+        if (got != total)
+            throw(array_exception(array_exception::IO_ERROR));
+    }
+
+    // a buffer is stored oldest first as its two storage segments
+    template <typename T>
+    inline void serialize(std::ostream& os, const buffer<T>& bf)
+    {
+        size_t ext[] = { bf.occupied() };
+        binary_header h = binary_header::make<T>(1, ext);
+        h.aux_ = bf.size();
+        h.write(os);
+        size_t n1 = bf.size() - bf.head();
+        if (n1 > bf.occupied()) n1 = bf.occupied();
+        binary_header::write_chunk(os, bf.data() + bf.head(), n1);
+        binary_header::write_chunk(os, bf.data(), bf.occupied() - n1);
+    }
+
+    template <typename T>
+    inline void deserialize(std::istream& is, buffer<T>& bf)
+    {
+        binary_header h;
+        h.read(is);
+        h.check<T>(1);
+        if (h.aux_ < h.ext_[0])
+            throw(array_exception(array_exception::IO_ERROR));
+        bf.set_size(static_cast<size_t>(h.aux_));
+        // empty, so the free slots are one run from index 0
+        T* p = bf.prepare().first;
+        size_t total = static_cast<size_t>(h.ext_[0]), got = 0;
+        uint64_t count;
+        uint32_t crc;
+        while ((got < total) && h.read_chunk(is, count, crc)) {
+            if (count > total - got)
+                throw(array_exception(array_exception::IO_ERROR));
+            h.read_payload(is, p + got, static_cast<size_t>(count), crc);
+            bf.commit(static_cast<size_t>(count));
+            got += static_cast<size_t>(count);
+        }
+        if (got != total)
+            throw(array_exception(array_exception::IO_ERROR));
+    }
+
+    // appends chunks of elements to a stream file. an existing file is
+    // resumed after its last complete chunk, a torn one is cut off.
+    template <typename T>
+    class array_writer
+    {
+        private:
+            std::fstream    fs_;
+            binary_header   h_;
+            uint64_t        count_;
+
+        public:
+            array_writer() : count_(0) {}
+
+            array_writer(const char* path, size_t dim = 1, const size_t* inner = NULL)
+                : count_(0)
+            {
+                open(path, dim, inner);
+            }
+
+            ~array_writer()
+            {
+                close();
+            }
+
+            // inner holds the dim-1 trailing extents of one record
+            inline void open(const char* path, size_t dim = 1, const size_t* inner = NULL)
+            {
+                close();
+                size_t ext[3] = { 0, 0, 0 };
+                for (size_t k = 1; k < dim; k++)
+                    ext[k] = inner[k-1];
+                h_     = binary_header::make<T>(dim, ext);
+                count_ = 0;
+
+                std::ifstream in(path, std::ios::in | std::ios::binary);
+                if (in) {
+                    std::streamoff end = resume_(in, dim);
+                    in.close();
+                    if (::truncate(path, end) < 0)
+                        throw(array_exception(array_exception::IO_ERROR));
+                    fs_.open(path, std::ios::in | std::ios::out | std::ios::binary);
+                    fs_.seekp(0, std::ios::end);
+                } else {
+                    fs_.open(path, std::ios::out | std::ios::binary);
+                    h_.write(fs_);
+                }
+                if (!fs_)
+                    throw(array_exception(array_exception::IO_ERROR));
+            }
+
+            inline void close(void)
+            {
+                if (fs_.is_open()) fs_.close();
+            }
+
+            inline void append(const T* p, size_t n)
+            {
+                binary_header::write_chunk(fs_, p, n);
+                count_ += n;
+            }
+
+            template <size_t dim>
+            inline void append(const array<T, dim>& ar)
+            {
+                append(ar.data(), ar.count());
+            }
+
+            inline void append(const buffer<T>& bf)
+            {
+                size_t n1 = bf.size() - bf.head();
+                if (n1 > bf.occupied()) n1 = bf.occupied();
+                append(bf.data() + bf.head(), n1);
+                append(bf.data(), bf.occupied() - n1);
+            }
+
+            inline void flush(void)
+            {
+                if (!fs_.flush())
+                    throw(array_exception(array_exception::IO_ERROR));
+            }
+
+            // elements in the file, including the ones of a resumed file
+            inline uint64_t count(void) const
+            {
+                return count_;
+            }
+
+        private:
+            inline std::streamoff resume_(std::istream& in, size_t dim)
+            {
+                binary_header h;
+                h.read(in);
+                h.check<T>(dim);
+                if (h.swap_)
+                    throw(array_exception(array_exception::IO_ERROR));
+                for (size_t k = 1; k < dim; k++)
+                    if (h.ext_[k] != h_.ext_[k])
+                        throw(array_exception(array_exception::DIM_ERROR));
+                std::streamoff end = in.tellg();
+                in.seekg(0, std::ios::end);
+                std::streamoff size = in.tellg();
+                in.seekg(end);
+                uint64_t n;
+                uint32_t crc;
+                try {
+                    while (h.read_chunk(in, n, crc)) {
+                        std::streamoff next = end + binary_header::CHUNK_SIZE
+                                            + static_cast<std::streamoff>(n * sizeof(T));
+                        if (next > size)
+                            break;
+                        in.seekg(next);
+                        end     = next;
+                        count_ += n;
+                    }
+                } catch (array_exception&) {
+                    // a torn chunk header at the end of the file
+                }
+                in.clear();
+                return end;
+            }
+
+    }; // class array_writer<T>
+
+    // reads a stream file chunk by chunk. tell() and seek() let a reader
+    // stop and resume where it left off.
+    template <typename T>
+    class array_reader
+    {
+        private:
+            std::ifstream   fs_;
+            binary_header   h_;
+
+        public:
+            array_reader() {}
+
+            array_reader(const char* path)
+            {
+                open(path);
+            }
+
+            inline void open(const char* path)
+            {
+                if (fs_.is_open()) fs_.close();
+                fs_.clear();
+                fs_.open(path, std::ios::in | std::ios::binary);
+                if (!fs_)
+                    throw(array_exception(array_exception::IO_ERROR));
+                h_.read(fs_);
+                h_.check<T>(h_.dim_);
+            }
+
+            inline const binary_header& header(void) const
+            {
+                return h_;
+            }
+
+            // reads the next chunk into out, false at the end of the file
+            inline bool next(array<T, 1>& out)
+            {
+                uint64_t n;
+                uint32_t crc;
+                if (!h_.read_chunk(fs_, n, crc)) {
+                    fs_.clear();
+                    return false;
+                }
+                if (out.size() != n)
+                    out.set_size(static_cast<size_t>(n));
+                h_.read_payload(fs_, out.data(), out.size(), crc);
+                return true;
+            }
+
+            // reads the remaining chunks as records of the stream's shape
+            template <size_t dim>
+            inline void read_all(array<T, dim>& out)
+            {
+                if (dim != h_.dim_)
+                    throw(array_exception(array_exception::DIM_ERROR));
+                array<T, 1> all, chunk;
+                size_t got = 0;
+                while (next(chunk)) {
+                    if (got + chunk.size() > all.size()) {
+                        array<T, 1> grown(2 * (got + chunk.size()));
+                        simd::copy(grown.data(), all.data(), got);
+                        all.swap(grown);
+                    }
+                    simd::copy(all.data() + got, chunk.data(), chunk.size());
+                    got += chunk.size();
+                }
+                size_t inner = static_cast<size_t>(h_.inner());
+                if (!inner || (got % inner))
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t ext[3] = { got / inner, static_cast<size_t>(h_.ext_[1]),
+                                  static_cast<size_t>(h_.ext_[2]) };
+                reshape_for_(out, ext);
+                simd::copy(out.data(), all.data(), got);
+            }
+
+            inline std::streamoff tell(void)
+            {
+                return fs_.tellg();
+            }
+
+            inline void seek(std::streamoff pos)
+            {
+                fs_.clear();
+                fs_.seekg(pos);
+            }
+
+    }; // class array_reader<T>
+
+} // namespace framework
+
+#endif // __SERIALIZE_H__
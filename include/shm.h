@@ -0,0 +1,471 @@
+//
+// shm.h
+//
+// ring buffer in a named shared-memory segment, for producers and a
+// consumer in different processes
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __SHM_H__
+#define __SHM_H__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <cstring>
+
+#include "array.h"
+
+#ifdef FRAMEWORK_CXX11
+#include <type_traits>
+#endif
+
+namespace framework
+{
+    // layout of the segment: this header, then capacity slots. every
+    // field a process writes after the setup sits on a line of its own.
+    struct shm_header_
+    {
+        enum { MAGIC = 0x46575348, VERSION = 2, LINE = 2 * ARRAY_ALIGNMENT };
+
+        uint32_t    magic;          // written last by the setup
+        uint32_t    version;
+        uint64_t    esize;
+        uint64_t    capacity;       // a power of two
+        uint64_t    mode;
+        uint64_t    generation;     // bumped whenever the segment is set up anew
+        char        pad0[LINE - 4 * sizeof(uint64_t) - 2 * sizeof(uint32_t)];
+
+        uint64_t    head;           // next position to pop
+        uint32_t    head_word;      // futex, bumped when head moves and a producer sleeps
+        uint32_t    producers;      // sleeping producers
+        char        pad1[LINE - sizeof(uint64_t) - 2 * sizeof(uint32_t)];
+
+        uint64_t    tail;           // next position to fill (SPSC) or claim (MPSC)
+        uint32_t    tail_word;      // futex, bumped when a slot is filled and the consumer sleeps
+        uint32_t    consumers;      // sleeping consumers
+        char        pad2[LINE - sizeof(uint64_t) - 2 * sizeof(uint32_t)];
+    };
+
+    // ring of trivially copyable elements in a POSIX shared-memory object,
+    // so producers and a consumer in different processes exchange them
+    // without copies through the kernel. the indices are in the segment:
+    // a process which attaches again continues where it stopped.
+    //
+    // each slot carries the position it was filled for (like mpmc_queue),
+    // so the consumer never reads a slot a producer is still writing.
+    // the SPSC producer fills the slot and then advances the tail with a
+    // plain store. a MPSC producer claims the slot at the tail with one
+    // compare-and-swap of its claim word, which holds the position and
+    // the producer's pid together, and any producer moves the tail past a
+    // claimed slot. there is one consumer. a blocked side sleeps on a
+    // futex in the segment.
+    //
+    // crash safety: the setup runs under an flock of the object and marks
+    // the header valid last, so a creator which died half way is redone
+    // by the next process to attach. an element being popped when the
+    // consumer died is popped again. a SPSC producer which died after
+    // filling a slot but before moving the tail has it moved by the next
+    // producer to attach. a MPSC producer which died between claiming and
+    // filling a slot leaves a hole, recover() skips it once the process is
+    // gone and reaped.
+    template <typename T>
+    class shm_buffer
+    {
+        public:
+            enum mode { SPSC = 1, MPSC = 2 };
+
+        private:
+            enum { SPIN = 128 };
+
+            struct slot_
+            {
+                uint64_t    seq;        // position + 1 once filled
+                uint64_t    claim;      // MPSC: low 32 bits of position + 1, then the pid
+                T           data;
+            };
+
+            shm_header_*    hdr_;
+            slot_*          slots_;
+            size_t          bytes_;
+            uint64_t        mask_;
+
+            shm_buffer(const shm_buffer&);
+            shm_buffer& operator= (const shm_buffer&);
+
+#ifdef FRAMEWORK_CXX11
+            static_assert(std::is_trivially_copyable<T>::value,
+                          "shared memory needs a trivially copyable element type");
+#endif
+
+            static inline size_t bytes_of_(uint64_t capacity)
+            {
+                return sizeof(shm_header_) + capacity * sizeof(slot_);
+            }
+
+            static inline long futex_(uint32_t* word, int op, uint32_t v, const timespec* rel)
+            {
+                return ::syscall(SYS_futex, word, op, v, rel, NULL, 0);
+            }
+
+            static inline double now_(void)
+            {
+                timespec t;
+                clock_gettime(CLOCK_MONOTONIC, &t);
+                return t.tv_sec + t.tv_nsec * 1e-9;
+            }
+
+            inline slot_& slot_at_(uint64_t pos) const
+            {
+                return slots_[pos & mask_];
+            }
+
+            // the fence pairs with the one of a sleeper between counting
+            // itself and trying again
+            static inline void wake_(uint32_t* word, uint32_t* sleepers)
+            {
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                if (__atomic_load_n(sleepers, __ATOMIC_RELAXED)) {
+                    __atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+                    futex_(word, FUTEX_WAKE, INT_MAX, NULL);
+                }
+            }
+
+            // calls op until it succeeds, sleeping on word in between.
+            // false if seconds (unless negative) passed first.
+            template <typename Op>
+            inline bool wait_(Op op, uint32_t* word, uint32_t* sleepers, double seconds)
+            {
+                for (int i = 0; i < SPIN; i++)
+                    if (op()) return true;
+                double end = (seconds < 0) ? 0 : now_() + seconds;
+                for (;;) {
+                    uint32_t seen = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+                    __atomic_add_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+                    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                    bool ok = op();
+                    if (!ok) {
+                        if (seconds < 0) {
+                            futex_(word, FUTEX_WAIT, seen, NULL);
+                        } else {
+                            double left = end - now_();
+                            if (left > 0) {
+                                timespec rel;
+                                rel.tv_sec  = static_cast<time_t>(left);
+                                rel.tv_nsec = static_cast<long>((left - rel.tv_sec) * 1e9);
+                                futex_(word, FUTEX_WAIT, seen, &rel);
+                            }
+                        }
+                    }
+                    __atomic_sub_fetch(sleepers, 1, __ATOMIC_SEQ_CST);
+                    if (ok) return true;
+                    if ((seconds >= 0) && (now_() >= end))
+                        return op();
+                }
+            }
+
+            static inline uint64_t claim_word_(uint64_t pos, uint32_t pid)
+            {
+                return (static_cast<uint64_t>(static_cast<uint32_t>(pos + 1)) << 32) | pid;
+            }
+
+            static inline bool claimed_for_(uint64_t c, uint64_t pos)
+            {
+                return static_cast<uint32_t>(c >> 32) == static_cast<uint32_t>(pos + 1);
+            }
+
+            // moves the tail from pos past the slot claimed for it
+            inline void advance_tail_(uint64_t pos)
+            {
+                __atomic_compare_exchange_n(&hdr_->tail, &pos, pos + 1, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            }
+
+            inline bool push_spsc_(const T& e)
+            {
+                shm_header_* h = hdr_;
+                uint64_t pos = __atomic_load_n(&h->tail, __ATOMIC_RELAXED);
+                // filled by a producer which died before moving the tail
+                while (__atomic_load_n(&slot_at_(pos).seq, __ATOMIC_ACQUIRE) == pos + 1)
+                    __atomic_store_n(&h->tail, ++pos, __ATOMIC_RELEASE);
+                if (pos - __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) > mask_)
+                    return false;
+                slot_& s = slot_at_(pos);
+                std::memcpy(&s.data, &e, sizeof(T));
+                __atomic_store_n(&s.seq, pos + 1, __ATOMIC_RELEASE);
+                __atomic_store_n(&h->tail, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            inline bool push_mpsc_(const T& e)
+            {
+                shm_header_* h = hdr_;
+                uint32_t pid = static_cast<uint32_t>(::getpid());
+                uint64_t pos;
+                for (;;) {
+                    pos = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE);
+                    uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+                    if (pos < head)
+                        continue;       // stale
+                    if (pos - head > mask_)
+                        return false;
+                    slot_& s = slot_at_(pos);
+                    uint64_t c = __atomic_load_n(&s.claim, __ATOMIC_ACQUIRE);
+                    if (claimed_for_(c, pos)) {
+                        advance_tail_(pos);
+                        continue;
+                    }
+                    // only over the claim of the lap before, pos is stale
+                    // if the slot was claimed for a later one meanwhile
+                    if (claimed_for_(c, pos - mask_ - 1) &&
+                        __atomic_compare_exchange_n(&s.claim, &c, claim_word_(pos, pid), false,
+                                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                        advance_tail_(pos);
+                        break;
+                    }
+                }
+                slot_& s = slot_at_(pos);
+                std::memcpy(&s.data, &e, sizeof(T));
+                __atomic_store_n(&s.seq, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            inline bool push_(const T& e)
+            {
+                return (hdr_->mode == SPSC) ? push_spsc_(e) : push_mpsc_(e);
+            }
+
+            inline bool pop_(T& e)
+            {
+                uint64_t pos = __atomic_load_n(&hdr_->head, __ATOMIC_RELAXED);
+                slot_& s = slot_at_(pos);
+                if (__atomic_load_n(&s.seq, __ATOMIC_ACQUIRE) != pos + 1)
+                    return false;
+                std::memcpy(&e, &s.data, sizeof(T));
+                __atomic_store_n(&hdr_->head, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+
+            struct push_op_
+            {
+                shm_buffer* b;
+                const T*    e;
+                inline bool operator() () const { return b->push_(*e); }
+            };
+
+            struct pop_op_
+            {
+                shm_buffer* b;
+                T*          e;
+                inline bool operator() () const { return b->pop_(*e); }
+            };
+
+            inline void fail_(int fd, void* p, size_t n, array_exception::category c)
+            {
+                if (p && (p != MAP_FAILED)) ::munmap(p, n);
+                ::flock(fd, LOCK_UN);
+                ::close(fd);
+                throw(array_exception(c));
+            }
+
+        public:
+            // attaches to the segment of name, or sets it up with capacity
+            // (rounded up to a power of two) if it doesn't exist or was
+            // left half done. capacity 0 only attaches. an existing segment
+            // has to match the element size and m, and hold capacity.
+            shm_buffer(const char* name, size_t capacity = 0, mode m = SPSC)
+                : hdr_(NULL), slots_(NULL), bytes_(0), mask_(0)
+            {
+                int fd = ::shm_open(name, O_RDWR | O_CREAT, 0600);
+                if (fd < 0)
+                    throw(array_exception(array_exception::IO_ERROR));
+                if (::flock(fd, LOCK_EX) < 0)
+                    fail_(fd, NULL, 0, array_exception::IO_ERROR);
+
+                struct stat st;
+                if (::fstat(fd, &st) < 0)
+                    fail_(fd, NULL, 0, array_exception::IO_ERROR);
+                size_t size = static_cast<size_t>(st.st_size);
+
+                // a valid header is taken as it is
+                uint64_t generation = 0;
+                if (size >= sizeof(shm_header_)) {
+                    void* p = ::mmap(NULL, sizeof(shm_header_), PROT_READ, MAP_SHARED, fd, 0);
+                    if (p == MAP_FAILED)
+                        fail_(fd, NULL, 0, array_exception::IO_ERROR);
+                    const shm_header_* h = static_cast<const shm_header_*>(p);
+                    bool valid = (h->magic == shm_header_::MAGIC) && (h->version == shm_header_::VERSION);
+                    if (valid && ((h->esize != sizeof(T)) || (h->mode != static_cast<uint64_t>(m))
+                                  || (capacity && (h->capacity < capacity))))
+                        fail_(fd, p, sizeof(shm_header_), array_exception::DIM_ERROR);
+                    valid = valid && (size >= bytes_of_(h->capacity));
+                    uint64_t cap = h->capacity;
+                    generation = h->generation;
+                    ::munmap(p, sizeof(shm_header_));
+                    if (valid) {
+                        bytes_ = bytes_of_(cap);
+                        p = ::mmap(NULL, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                        if (p == MAP_FAILED)
+                            fail_(fd, NULL, 0, array_exception::IO_ERROR);
+                        hdr_   = static_cast<shm_header_*>(p);
+                        slots_ = reinterpret_cast<slot_*>(hdr_ + 1);
+                        mask_  = cap - 1;
+                        ::flock(fd, LOCK_UN);
+                        ::close(fd);
+                        return;
+                    }
+                }
+
+                // set up anew
+                if (!capacity)
+                    fail_(fd, NULL, 0, array_exception::NOT_ALLOCATED);
+                uint64_t cap = 1;
+                while (cap < capacity) cap <<= 1;
+                bytes_ = bytes_of_(cap);
+                if (::ftruncate(fd, bytes_) < 0)
+                    fail_(fd, NULL, 0, array_exception::IO_ERROR);
+                void* p = ::mmap(NULL, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED)
+                    fail_(fd, NULL, 0, array_exception::IO_ERROR);
+                std::memset(p, 0, bytes_);
+                hdr_   = static_cast<shm_header_*>(p);
+                slots_ = reinterpret_cast<slot_*>(hdr_ + 1);
+                mask_  = cap - 1;
+                // as if claimed a lap before
+                for (uint64_t i = 0; i < cap; i++)
+                    slots_[i].claim = claim_word_(i - cap, 0);
+                hdr_->version    = shm_header_::VERSION;
+                hdr_->esize      = sizeof(T);
+                hdr_->capacity   = cap;
+                hdr_->mode       = m;
+                hdr_->generation = generation + 1;
+                __atomic_store_n(&hdr_->magic, static_cast<uint32_t>(shm_header_::MAGIC), __ATOMIC_RELEASE);
+                ::msync(p, sizeof(shm_header_), MS_ASYNC);
+                ::flock(fd, LOCK_UN);
+                ::close(fd);
+            }
+
+            // detaches, the segment stays until unlink()
+            ~shm_buffer()
+            {
+                if (hdr_)
+                    ::munmap(hdr_, bytes_);
+            }
+
+            static inline void unlink(const char* name)
+            {
+                ::shm_unlink(name);
+            }
+
+            inline size_t capacity(void) const
+            {
+                return static_cast<size_t>(mask_ + 1);
+            }
+
+            inline mode get_mode(void) const
+            {
+                return static_cast<mode>(hdr_->mode);
+            }
+
+            inline uint64_t generation(void) const
+            {
+                return hdr_->generation;
+            }
+
+            // claimed, whether filled yet or not. exact only when idle
+            inline size_t occupied(void) const
+            {
+                uint64_t h = __atomic_load_n(&hdr_->head, __ATOMIC_ACQUIRE);
+                uint64_t t = __atomic_load_n(&hdr_->tail, __ATOMIC_ACQUIRE);
+                return (t > h) ? static_cast<size_t>(t - h) : 0;
+            }
+
+            inline bool try_push(const T& e)
+            {
+                if (!push_(e))
+                    return false;
+                wake_(&hdr_->tail_word, &hdr_->consumers);
+                return true;
+            }
+
+            inline void push(const T& e)
+            {
+                push_op_ op = { this, &e };
+                wait_(op, &hdr_->head_word, &hdr_->producers, -1);
+                wake_(&hdr_->tail_word, &hdr_->consumers);
+            }
+
+            inline bool push_for(const T& e, double seconds)
+            {
+                push_op_ op = { this, &e };
+                if (!wait_(op, &hdr_->head_word, &hdr_->producers, seconds))
+                    return false;
+                wake_(&hdr_->tail_word, &hdr_->consumers);
+                return true;
+            }
+
+            inline bool try_pop(T& e)
+            {
+                if (!pop_(e))
+                    return false;
+                wake_(&hdr_->head_word, &hdr_->producers);
+                return true;
+            }
+
+            inline void pop(T& e)
+            {
+                pop_op_ op = { this, &e };
+                wait_(op, &hdr_->tail_word, &hdr_->consumers, -1);
+                wake_(&hdr_->head_word, &hdr_->producers);
+            }
+
+            inline bool pop_for(T& e, double seconds)
+            {
+                pop_op_ op = { this, &e };
+                if (!wait_(op, &hdr_->tail_word, &hdr_->consumers, seconds))
+                    return false;
+                wake_(&hdr_->head_word, &hdr_->producers);
+                return true;
+            }
+
+            // consumer side. skips the slots at the head which were
+            // claimed by a MPSC producer that no longer exists and never
+            // filled, returns how many. a dead child has to be reaped first.
+            inline size_t recover(void)
+            {
+                size_t n = 0;
+                while (hdr_->mode == MPSC) {
+                    uint64_t pos = __atomic_load_n(&hdr_->head, __ATOMIC_RELAXED);
+                    slot_& s = slot_at_(pos);
+                    uint64_t c = __atomic_load_n(&s.claim, __ATOMIC_ACQUIRE);
+                    if (!claimed_for_(c, pos) || (__atomic_load_n(&s.seq, __ATOMIC_ACQUIRE) == pos + 1))
+                        break;
+                    pid_t pid = static_cast<pid_t>(static_cast<uint32_t>(c));
+                    if ((::kill(pid, 0) == 0) || (errno != ESRCH))
+                        break;
+                    advance_tail_(pos);
+                    __atomic_store_n(&hdr_->head, pos + 1, __ATOMIC_RELEASE);
+                    n++;
+                }
+                if (n)
+                    wake_(&hdr_->head_word, &hdr_->producers);
+                return n;
+            }
+
+    }; // class shm_buffer<T>
+
+} // namespace framework
+
+#endif // __SHM_H__
@@ -0,0 +1,327 @@
+//
+// simd.h
+//
+// SSE2/AVX2 kernels over contiguous storage with runtime dispatch
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <cstddef>
+#include <cstring>
+
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAMEWORK_SIMD_X86
+#define FRAMEWORK_TARGET(isa)   __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
+namespace framework
+{
+namespace simd
+{
+    enum level_type { SCALAR = 0, SSE2 = 1, AVX2 = 2 };
+
+    inline int detect(void)
+    {
+#ifdef FRAMEWORK_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return AVX2;
+        if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+        return SCALAR;
+    }
+
+    inline int& level_(void)
+    {
+        static int l = detect();
+        return l;
+    }
+
+    // instruction set used by the kernels, the best one the cpu supports
+    inline int level(void)
+    {
+        return level_();
+    }
+
+    // restricts the kernels to a lower instruction set, mainly for tests
+    inline void set_level(int l)
+    {
+        int d = detect();
+        level_() = (l < d) ? l : d;
+    }
+
+    // loop kernels. the compiler vectorizes them for the instruction set
+    // in their target attribute, so one body serves every element type.
+
+    #define FRAMEWORK_LOOP_KERNELS(suffix, attr)                            \
+    template <typename T>                                                   \
+    attr inline void fill_##suffix(T* p, size_t n, const T v)               \
+    {                                                                       \
+        for (size_t i = 0; i < n; i++) p[i] = v;                            \
+    }                                                                       \
+                                                                            \
+    template <typename D, typename S>                                       \
+    attr inline void convert_##suffix(D* d, const S* s, size_t n)           \
+    {                                                                       \
+        for (size_t i = 0; i < n; i++) d[i] = static_cast<D>(s[i]);         \
+    }                                                                       \
+                                                                            \
+    template <typename T>                                                   \
+    attr inline void axpy_##suffix(T* y, const T a, const T* x, size_t n)   \
+    {                                                                       \
+        for (size_t i = 0; i < n; i++) y[i] += a * x[i];                    \
+    }                                                                       \
+                                                                            \
+    template <typename T>                                                   \
+    attr inline T sum_##suffix(const T* p, size_t n)                        \
+    {                                                                       \
+        T s = T();                                                          \
+        for (size_t i = 0; i < n; i++) s += p[i];                           \
+        return s;                                                           \
+    }                                                                       \
+                                                                            \
+    template <typename T>                                                   \
+    attr inline T dot_##suffix(const T* x, const T* y, size_t n)            \
+    {                                                                       \
+        T s = T();                                                          \
+        for (size_t i = 0; i < n; i++) s += x[i] * y[i];                    \
+        return s;                                                           \
+    }                                                                       \
+                                                                            \
+    template <typename T>                                                   \
+    attr inline T min_##suffix(const T* p, size_t n)                        \
+    {                                                                       \
+        T m = p[0];                                                         \
+        for (size_t i = 1; i < n; i++) m = (p[i] < m) ? p[i] : m;           \
+        return m;                                                           \
+    }                                                                       \
+                                                                            \
+    template <typename T>                                                   \
+    attr inline T max_##suffix(const T* p, size_t n)                        \
+    {                                                                       \
+        T m = p[0];                                                         \
+        for (size_t i = 1; i < n; i++) m = (m < p[i]) ? p[i] : m;           \
+        return m;                                                           \
+    }
+
+    FRAMEWORK_LOOP_KERNELS(scalar, )
+#ifdef FRAMEWORK_SIMD_X86
+    FRAMEWORK_LOOP_KERNELS(sse2, FRAMEWORK_TARGET("sse2"))
+    FRAMEWORK_LOOP_KERNELS(avx2, FRAMEWORK_TARGET("avx2"))
+#endif
+
+    #undef FRAMEWORK_LOOP_KERNELS
+
+#ifdef FRAMEWORK_SIMD_X86
+    // floating-point reductions aren't reassociated by the compiler, so
+    // they are written out with two independent vector accumulators.
+
+    FRAMEWORK_TARGET("sse2") inline float hsum_sse2(__m128 v)
+    {
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+    }
+
+    FRAMEWORK_TARGET("sse2") inline double hsum_sse2(__m128d v)
+    {
+        return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+    }
+
+    FRAMEWORK_TARGET("avx2") inline float hsum_avx2(__m256 v)
+    {
+        __m128 h = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+        h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+        return _mm_cvtss_f32(h);
+    }
+
+    FRAMEWORK_TARGET("avx2") inline double hsum_avx2(__m256d v)
+    {
+        __m128d h = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    }
+
+    #define FRAMEWORK_REDUCE_KERNELS(suffix, attr, T, V, W, ld, add, mul, mn, mx, set1) \
+    template <>                                                             \
+    attr inline T sum_##suffix<T>(const T* p, size_t n)                     \
+    {                                                                       \
+        V a0 = set1(0), a1 = set1(0);                                       \
+        size_t i = 0;                                                       \
+        for (; i + 2 * W <= n; i += 2 * W) {                                \
+            a0 = add(a0, ld(p + i));                                        \
+            a1 = add(a1, ld(p + i + W));                                    \
+        }                                                                   \
+        T s = hsum_##suffix(add(a0, a1));                                   \
+        for (; i < n; i++) s += p[i];                                       \
+        return s;                                                           \
+    }                                                                       \
+                                                                            \
+    template <>                                                             \
+    attr inline T dot_##suffix<T>(const T* x, const T* y, size_t n)         \
+    {                                                                       \
+        V a0 = set1(0), a1 = set1(0);                                       \
+        size_t i = 0;                                                       \
+        for (; i + 2 * W <= n; i += 2 * W) {                                \
+            a0 = add(a0, mul(ld(x + i), ld(y + i)));                        \
+            a1 = add(a1, mul(ld(x + i + W), ld(y + i + W)));                \
+        }                                                                   \
+        T s = hsum_##suffix(add(a0, a1));                                   \
+        for (; i < n; i++) s += x[i] * y[i];                                \
+        return s;                                                           \
+    }                                                                       \
+                                                                            \
+    template <>                                                             \
+    attr inline T min_##suffix<T>(const T* p, size_t n)                     \
+    {                                                                       \
+        if (n < W) return min_scalar(p, n);                                 \
+        V m = ld(p);                                                        \
+        size_t i = W;                                                       \
+        for (; i + W <= n; i += W) m = mn(m, ld(p + i));                    \
+        T b[W];                                                             \
+        std::memcpy(b, &m, sizeof(b));                                      \
+        T r = min_scalar(b, W);                                             \
+        for (; i < n; i++) r = (p[i] < r) ? p[i] : r;                       \
+        return r;                                                           \
+    }                                                                       \
+                                                                            \
+    template <>                                                             \
+    attr inline T max_##suffix<T>(const T* p, size_t n)                     \
+    {                                                                       \
+        if (n < W) return max_scalar(p, n);                                 \
+        V m = ld(p);                                                        \
+        size_t i = W;                                                       \
+        for (; i + W <= n; i += W) m = mx(m, ld(p + i));                    \
+        T b[W];                                                             \
+        std::memcpy(b, &m, sizeof(b));                                      \
+        T r = max_scalar(b, W);                                             \
+        for (; i < n; i++) r = (r < p[i]) ? p[i] : r;                       \
+        return r;                                                           \
+    }
+
+    FRAMEWORK_REDUCE_KERNELS(sse2, FRAMEWORK_TARGET("sse2"), float, __m128, 4,
+        _mm_loadu_ps, _mm_add_ps, _mm_mul_ps, _mm_min_ps, _mm_max_ps, _mm_set1_ps)
+    FRAMEWORK_REDUCE_KERNELS(sse2, FRAMEWORK_TARGET("sse2"), double, __m128d, 2,
+        _mm_loadu_pd, _mm_add_pd, _mm_mul_pd, _mm_min_pd, _mm_max_pd, _mm_set1_pd)
+    FRAMEWORK_REDUCE_KERNELS(avx2, FRAMEWORK_TARGET("avx2"), float, __m256, 8,
+        _mm256_loadu_ps, _mm256_add_ps, _mm256_mul_ps, _mm256_min_ps, _mm256_max_ps, _mm256_set1_ps)
+    FRAMEWORK_REDUCE_KERNELS(avx2, FRAMEWORK_TARGET("avx2"), double, __m256d, 4,
+        _mm256_loadu_pd, _mm256_add_pd, _mm256_mul_pd, _mm256_min_pd, _mm256_max_pd, _mm256_set1_pd)
+
+    #undef FRAMEWORK_REDUCE_KERNELS
+#endif
+
+    // dispatching entry points
+
+#ifdef FRAMEWORK_SIMD_X86
+    #define FRAMEWORK_DISPATCH(name, args)                                  \
+        switch (level()) {                                                  \
+            case AVX2: return name##_avx2 args;                             \
+            case SSE2: return name##_sse2 args;                             \
+            default:   return name##_scalar args;                           \
+        }
+#else
+    #define FRAMEWORK_DISPATCH(name, args)                                  \
+        return name##_scalar args;
+#endif
+
+    template <typename T>
+    inline void fill(T* p, size_t n, const T v)
+    {
+        FRAMEWORK_DISPATCH(fill, (p, n, v))
+    }
+
+    template <typename D, typename S>
+    inline void convert(D* d, const S* s, size_t n)
+    {
+        FRAMEWORK_DISPATCH(convert, (d, s, n))
+    }
+
+    // y += a * x
+    template <typename T>
+    inline void axpy(T* y, const T a, const T* x, size_t n)
+    {
+        FRAMEWORK_DISPATCH(axpy, (y, a, x, n))
+    }
+
+    template <typename T>
+    inline T sum(const T* p, size_t n)
+    {
+        FRAMEWORK_DISPATCH(sum, (p, n))
+    }
+
+    template <typename T>
+    inline T dot(const T* x, const T* y, size_t n)
+    {
+        FRAMEWORK_DISPATCH(dot, (x, y, n))
+    }
+
+    // n must be positive
+    template <typename T>
+    inline T min(const T* p, size_t n)
+    {
+        FRAMEWORK_DISPATCH(min, (p, n))
+    }
+
+    template <typename T>
+    inline T max(const T* p, size_t n)
+    {
+        FRAMEWORK_DISPATCH(max, (p, n))
+    }
+
+    #undef FRAMEWORK_DISPATCH
+
+    // element copy, a single memcpy for the arithmetic types and, since
+    // c++11, for every trivially copyable one
+    template <typename T>
+    inline void copy(T* d, const T* s, size_t n)
+    {
+#if __cplusplus >= 201103L
+        if (std::is_trivially_copyable<T>::value) {
+            if (n) std::memcpy(d, s, n * sizeof(T));
+            return;
+        }
+#endif
+        for (size_t i = 0; i < n; i++) d[i] = s[i];
+    }
+
+    #define FRAMEWORK_MEMCPY_COPY(T)                                        \
+    template <>                                                             \
+    inline void copy<T>(T* d, const T* s, size_t n)                         \
+    {                                                                       \
+        if (n) std::memcpy(d, s, n * sizeof(T));                            \
+    }
+
+    FRAMEWORK_MEMCPY_COPY(char)
+    FRAMEWORK_MEMCPY_COPY(signed char)
+    FRAMEWORK_MEMCPY_COPY(unsigned char)
+    FRAMEWORK_MEMCPY_COPY(short)
+    FRAMEWORK_MEMCPY_COPY(unsigned short)
+    FRAMEWORK_MEMCPY_COPY(int)
+    FRAMEWORK_MEMCPY_COPY(unsigned int)
+    FRAMEWORK_MEMCPY_COPY(long)
+    FRAMEWORK_MEMCPY_COPY(unsigned long)
+    FRAMEWORK_MEMCPY_COPY(float)
+    FRAMEWORK_MEMCPY_COPY(double)
+    FRAMEWORK_MEMCPY_COPY(long double)
+
+    #undef FRAMEWORK_MEMCPY_COPY
+
+    template <typename T>
+    inline void convert(T* d, const T* s, size_t n)
+    {
+        copy(d, s, n);
+    }
+
+} // namespace simd
+} // namespace framework
+
+#endif // __SIMD_H__
@@ -0,0 +1,490 @@
+//
+// sparse.h
+//
+// sparse 2-d array, built as coordinates (COO) and computed on as
+// compressed rows (CSR)
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __SPARSE_H__
+#define __SPARSE_H__
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "array.h"
+#include "parallel.h"
+#include "simd.h"
+
+namespace framework
+{
+    // nonzeros as (row, column, value) in any order, for building. a
+    // coordinate may be inserted more than once, the values are summed
+    // when it's compressed into a sparse_array.
+    template <typename T>
+    class coo_array
+    {
+        template <typename U> friend class sparse_array;
+
+        private:
+            size_t              s1_, s2_;
+            std::vector<size_t> row_;
+            std::vector<size_t> col_;
+            std::vector<T>      val_;
+
+        public:
+            coo_array() : s1_(0), s2_(0) {}
+
+            coo_array(size_t s1, size_t s2) : s1_(s1), s2_(s2) {}
+
+            inline void set_size(size_t s1, size_t s2)
+            {
+                clear();
+                s1_ = s1;
+                s2_ = s2;
+            }
+
+            inline void clear(void)
+            {
+                row_.clear();
+                col_.clear();
+                val_.clear();
+            }
+
+            inline void reserve(size_t n)
+            {
+                row_.reserve(n);
+                col_.reserve(n);
+                val_.reserve(n);
+            }
+
+            template <typename T2>
+            inline void insert(size_t i, size_t j, const T2 v)
+            {
+                if ((i >= s1_) || (j >= s2_))
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                row_.push_back(i);
+                col_.push_back(j);
+                val_.push_back(static_cast<T>(v));
+            }
+
+            inline size_t size(const size_t o = 0, const size_t d = 2) const
+            {
+                return (d - o == 2) ? s1_ : s2_;
+            }
+
+            inline size_t nonzeros(void) const
+            {
+                return val_.size();
+            }
+
+    }; // class coo_array<T>
+
+    // compressed sparse rows: the nonzeros of row i are
+    // [offsets()[i], offsets()[i+1]) of indices() and values(), sorted by
+    // column. memory and every loop scale with the nonzeros only.
+    template <typename T>
+    class sparse_array
+    {
+        private:
+            size_t              s1_, s2_;
+            std::vector<size_t> ptr_;       // s1_ + 1 offsets
+            std::vector<size_t> col_;
+            std::vector<T>      val_;
+
+        public:
+            sparse_array() : s1_(0), s2_(0), ptr_(1, 0) {}
+
+            sparse_array(size_t s1, size_t s2) : s1_(s1), s2_(s2), ptr_(s1 + 1, 0) {}
+
+            explicit sparse_array(const coo_array<T>& coo) : s1_(0), s2_(0)
+            {
+                operator= (coo);
+            }
+
+            template <typename T2>
+            explicit sparse_array(const array<T2, 2>& dense) : s1_(0), s2_(0)
+            {
+                operator= (dense);
+            }
+
+            inline void set_size(size_t s1, size_t s2)
+            {
+                s1_ = s1;
+                s2_ = s2;
+                ptr_.assign(s1 + 1, 0);
+                col_.clear();
+                val_.clear();
+            }
+
+            inline void clear(void)
+            {
+                set_size(0, 0);
+            }
+
+            inline void swap(sparse_array<T>& other)
+            {
+                std::swap(s1_, other.s1_);
+                std::swap(s2_, other.s2_);
+                ptr_.swap(other.ptr_);
+                col_.swap(other.col_);
+                val_.swap(other.val_);
+            }
+
+            // counting sort by row, then by column within each row
+            inline sparse_array<T>& operator= (const coo_array<T>& coo)
+            {
+                size_t n = coo.nonzeros();
+                set_size(coo.s1_, coo.s2_);
+                for (size_t k = 0; k < n; k++)
+                    ptr_[coo.row_[k] + 1]++;
+                for (size_t i = 0; i < s1_; i++)
+                    ptr_[i + 1] += ptr_[i];
+
+                std::vector<size_t> next(ptr_.begin(), ptr_.end() - 1);
+                std::vector<std::pair<size_t, size_t> > order(n);
+                for (size_t k = 0; k < n; k++)
+                    order[next[coo.row_[k]]++] = std::make_pair(coo.col_[k], k);
+
+                // duplicates are summed in the order they were inserted
+                col_.reserve(n);
+                val_.reserve(n);
+                size_t b = 0;
+                for (size_t i = 0; i < s1_; i++) {
+                    size_t e = ptr_[i + 1];
+                    std::sort(order.begin() + b, order.begin() + e);
+                    ptr_[i] = col_.size();
+                    for (size_t k = b; k < e; k++) {
+                        if ((k > b) && (order[k].first == col_.back()))
+                            val_.back() += coo.val_[order[k].second];
+                        else {
+                            col_.push_back(order[k].first);
+                            val_.push_back(coo.val_[order[k].second]);
+                        }
+                    }
+                    b = e;
+                }
+                ptr_[s1_] = col_.size();
+                return *this;
+            }
+
+            // keeps the elements which don't compare equal to zero
+            template <typename T2>
+            inline sparse_array<T>& operator= (const array<T2, 2>& dense)
+            {
+                set_size(dense.size(0), dense.size(1));
+                const T2* p = dense.data();
+                for (size_t i = 0; i < s1_; i++, p += s2_) {
+                    for (size_t j = 0; j < s2_; j++) {
+                        if (!(p[j] == T2())) {
+                            col_.push_back(j);
+                            val_.push_back(static_cast<T>(p[j]));
+                        }
+                    }
+                    ptr_[i + 1] = col_.size();
+                }
+                return *this;
+            }
+
+            // zeros, then the nonzeros scattered into place
+            template <typename T2>
+            inline void dense(array<T2, 2>& out) const
+            {
+                if ((out.size(0) != s1_) || (out.size(1) != s2_))
+                    out.set_size(s1_, s2_);
+                simd::fill(out.data(), out.count(), T2());
+                T2* p = out.data();
+                for (size_t i = 0; i < s1_; i++, p += s2_)
+                    for (size_t k = ptr_[i]; k < ptr_[i + 1]; k++)
+                        p[col_[k]] = static_cast<T2>(val_[k]);
+            }
+
+            inline size_t size(const size_t o = 0, const size_t d = 2) const
+            {
+                return (d - o == 2) ? s1_ : s2_;
+            }
+
+            inline size_t nonzeros(void) const
+            {
+                return val_.size();
+            }
+
+            // the stored value or zero, by binary search in the row
+            inline T operator() (size_t i, size_t j) const
+            {
+                if ((i >= s1_) || (j >= s2_))
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                if (ptr_[i] == ptr_[i + 1])
+                    return T();
+                const size_t* b = &col_[0] + ptr_[i];
+                const size_t* e = &col_[0] + ptr_[i + 1];
+                const size_t* c = std::lower_bound(b, e, j);
+                return ((c != e) && (*c == j)) ? val_[c - &col_[0]] : T();
+            }
+
+            inline const size_t* offsets(void) const
+            {
+                return &ptr_[0];
+            }
+
+            inline const size_t* indices(void) const
+            {
+                return col_.empty() ? NULL : &col_[0];
+            }
+
+            inline const T* values(void) const
+            {
+                return val_.empty() ? NULL : &val_[0];
+            }
+
+            inline T* values(void)
+            {
+                return val_.empty() ? NULL : &val_[0];
+            }
+
+            // element-wise, the shapes have to match
+            inline sparse_array<T>& operator+= (const sparse_array<T>& rhs)
+            {
+                sparse_array<T> r;
+                merge_(*this, rhs, T(1), r);
+                swap(r);
+                return *this;
+            }
+
+            inline sparse_array<T>& operator-= (const sparse_array<T>& rhs)
+            {
+                sparse_array<T> r;
+                merge_(*this, rhs, T(-1), r);
+                swap(r);
+                return *this;
+            }
+
+            template <typename T2>
+            inline sparse_array<T>& operator*= (const T2 v)
+            {
+                for (size_t k = 0; k < val_.size(); k++)
+                    val_[k] *= static_cast<T>(v);
+                return *this;
+            }
+
+            template <typename T2>
+            inline sparse_array<T>& operator/= (const T2 v)
+            {
+                for (size_t k = 0; k < val_.size(); k++)
+                    val_[k] /= static_cast<T>(v);
+                return *this;
+            }
+
+            // element-wise product, only the nonzeros both of them have are
+            // kept, in place since it never adds any
+            inline sparse_array<T>& hadamard(const sparse_array<T>& rhs)
+            {
+                if ((s1_ != rhs.s1_) || (s2_ != rhs.s2_))
+                    throw(array_exception(array_exception::DIM_ERROR));
+                size_t n = 0;
+                for (size_t i = 0; i < s1_; i++) {
+                    size_t p = ptr_[i], q = rhs.ptr_[i];
+                    ptr_[i] = n;
+                    while ((p < ptr_[i + 1]) && (q < rhs.ptr_[i + 1])) {
+                        if (col_[p] < rhs.col_[q])
+                            p++;
+                        else if (rhs.col_[q] < col_[p])
+                            q++;
+                        else {
+                            col_[n]   = col_[p];
+                            val_[n++] = val_[p++] * rhs.val_[q++];
+                        }
+                    }
+                }
+                ptr_[s1_] = n;
+                col_.resize(n);
+                val_.resize(n);
+                return *this;
+            }
+
+        private:
+            // r = a + s * b, the union of the nonzeros of each row
+            static inline void merge_(const sparse_array<T>& a, const sparse_array<T>& b,
+                                      const T s, sparse_array<T>& r)
+            {
+                if ((a.s1_ != b.s1_) || (a.s2_ != b.s2_))
+                    throw(array_exception(array_exception::DIM_ERROR));
+                r.set_size(a.s1_, a.s2_);
+                r.col_.reserve(a.nonzeros() + b.nonzeros());
+                r.val_.reserve(a.nonzeros() + b.nonzeros());
+                for (size_t i = 0; i < a.s1_; i++) {
+                    size_t p = a.ptr_[i], pe = a.ptr_[i + 1];
+                    size_t q = b.ptr_[i], qe = b.ptr_[i + 1];
+                    while ((p < pe) || (q < qe)) {
+                        if ((q == qe) || ((p < pe) && (a.col_[p] < b.col_[q]))) {
+                            r.col_.push_back(a.col_[p]);
+                            r.val_.push_back(a.val_[p++]);
+                        } else if ((p == pe) || (b.col_[q] < a.col_[p])) {
+                            r.col_.push_back(b.col_[q]);
+                            r.val_.push_back(s * b.val_[q++]);
+                        } else {
+                            r.col_.push_back(a.col_[p]);
+                            r.val_.push_back(a.val_[p++] + s * b.val_[q++]);
+                        }
+                    }
+                    r.ptr_[i + 1] = r.col_.size();
+                }
+            }
+
+    }; // class sparse_array<T>
+
+    template <typename T>
+    inline sparse_array<T> operator+ (const sparse_array<T>& a, const sparse_array<T>& b)
+    {
+        sparse_array<T> r = a;
+        return r += b;
+    }
+
+    template <typename T>
+    inline sparse_array<T> operator- (const sparse_array<T>& a, const sparse_array<T>& b)
+    {
+        sparse_array<T> r = a;
+        return r -= b;
+    }
+
+    template <typename T, typename T2>
+    inline sparse_array<T> operator* (const sparse_array<T>& a, const T2 v)
+    {
+        sparse_array<T> r = a;
+        return r *= v;
+    }
+
+    template <typename T>
+    inline sparse_array<T> hadamard(const sparse_array<T>& a, const sparse_array<T>& b)
+    {
+        sparse_array<T> r = a;
+        return r.hadamard(b);
+    }
+
+    // rows per chunk of a sparse product, so that a chunk touches about
+    // FRAMEWORK_PARALLEL_CHUNK bytes of nonzeros
+    template <typename T>
+    inline size_t sparse_grain_(const sparse_array<T>& a, size_t row_bytes)
+    {
+        size_t per_row = a.size() ? a.nonzeros() / a.size() : 0;
+        size_t g = FRAMEWORK_PARALLEL_CHUNK / (per_row * (sizeof(T) + sizeof(size_t)) + row_bytes + 1);
+        return g ? g : 1;
+    }
+
+    template <typename T>
+    struct spmv_rows_
+    {
+        const size_t*   ptr;
+        const size_t*   col;
+        const T*        val;
+        const T*        x;
+        T*              y;
+        T               alpha, beta;
+
+        inline void operator() (size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++) {
+                T t = T();
+                for (size_t k = ptr[i]; k < ptr[i + 1]; k++)
+                    t += val[k] * x[col[k]];
+                y[i] = (beta == T()) ? alpha * t : alpha * t + beta * y[i];
+            }
+        }
+    };
+
+    // y = alpha * A * x + beta * y with a sparse A, an empty y is sized
+    // to the product
+    template <typename S, typename T>
+    inline void gemv(const S alpha, const sparse_array<T>& A, const array<T, 1>& x,
+                     const S beta, array<T, 1>& y, bool threaded = true)
+    {
+        if (!y.size() && A.size())
+            y.set_size(A.size(0));
+        if ((A.size(1) != x.size()) || (A.size(0) != y.size()))
+            throw(array_exception(array_exception::DIM_ERROR));
+        spmv_rows_<T> rows = { A.offsets(), A.indices(), A.values(), x.data(), y.data(),
+                               static_cast<T>(alpha), static_cast<T>(beta) };
+        if (threaded)
+            parallel_for(A.size(0), sparse_grain_(A, sizeof(T)), rows);
+        else
+            rows(0, A.size(0));
+    }
+
+    // each nonzero a(i, k) adds a row of B to row i of C with axpy
+    template <typename T>
+    struct spmm_rows_
+    {
+        const size_t*   ptr;
+        const size_t*   col;
+        const T*        val;
+        const T*        b;
+        T*              c;
+        size_t          n;
+        T               alpha, beta;
+
+        inline void operator() (size_t lo, size_t hi)
+        {
+            for (size_t i = lo; i < hi; i++) {
+                T* ci = c + i * n;
+                if (beta == T())
+                    simd::fill(ci, n, T());
+                else if (beta != T(1))
+                    for (size_t j = 0; j < n; j++) ci[j] *= beta;
+                for (size_t k = ptr[i]; k < ptr[i + 1]; k++)
+                    simd::axpy(ci, alpha * val[k], b + col[k] * n, n);
+            }
+        }
+    };
+
+    // C = alpha * A * B + beta * C with a sparse A, an empty C is sized
+    // to the product
+    template <typename S, typename T>
+    inline void gemm(const S alpha, const sparse_array<T>& A, const array<T, 2>& B,
+                     const S beta, array<T, 2>& C, bool threaded = true)
+    {
+        if (!C.size() && A.size() && B.size(1))
+            C.set_size(A.size(0), B.size(1));
+        if ((A.size(1) != B.size(0)) || (A.size(0) != C.size(0)) || (B.size(1) != C.size(1)))
+            throw(array_exception(array_exception::DIM_ERROR));
+        spmm_rows_<T> rows = { A.offsets(), A.indices(), A.values(), B.data(), C.data(),
+                               B.size(1), static_cast<T>(alpha), static_cast<T>(beta) };
+        if (threaded)
+            parallel_for(A.size(0), sparse_grain_(A, B.size(1) * sizeof(T)), rows);
+        else
+            rows(0, A.size(0));
+    }
+
+    // as the dense equivalent, the zeros are written out row by row
+    template <typename T>
+    inline void write_text(text_writer& w, const sparse_array<T>& sp)
+    {
+        size_t s1 = sp.size(0), s2 = sp.size(1);
+        if (!s1)
+            w.empty();
+        for (size_t i = 0; i < s1; i++) {
+            if (!s2)
+                w.empty();
+            size_t k = sp.offsets()[i], e = sp.offsets()[i + 1];
+            for (size_t j = 0; j < s2; j++) {
+                if ((k < e) && (sp.indices()[k] == j))
+                    w.put(sp.values()[k++]);
+                else
+                    w.put(T());
+                w.separator();
+            }
+            w.row();
+        }
+    }
+
+    template <typename T>
+    inline std::ostream& operator<< (std::ostream& os, const sparse_array<T>& sp)
+    {
+        return print(os, sp);
+    }
+
+} // namespace framework
+
+#endif // __SPARSE_H__
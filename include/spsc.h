@@ -0,0 +1,186 @@
+//
+// spsc.h
+//
+// lock-free single-producer/single-consumer ring buffer
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __SPSC_H__
+#define __SPSC_H__
+
+#include "array.h"
+#include "memory.h"
+
+#ifdef FRAMEWORK_CXX11
+#include <type_traits>
+#endif
+
+namespace framework
+{
+    // ring buffer for exactly one producer thread and one consumer thread.
+    // head and tail only ever grow and are read by the other side with
+    // acquire/release atomics, each side also keeps the last index of the
+    // other it has seen so it touches the shared line only when the ring
+    // looks full or empty. the capacity is rounded up to a power of two.
+    //
+    // with overwrite set, push() drops the oldest element when the ring is
+    // full like buffer::push does. the consumer then claims an element
+    // with a compare-and-swap after copying it and retries if the producer
+    // took the slot meanwhile, so T has to be trivially copyable.
+    template <typename T, bool overwrite = false>
+    class spsc_buffer
+    {
+        private:
+            // two lines apart, the fields of different sides never share a
+            // line however the object is aligned, and the adjacent-line
+            // prefetcher doesn't pair them either
+            enum { LINE = 2 * ARRAY_ALIGNMENT };
+
+            struct shared_
+            {
+                T*                  ring;
+                size_t              mask;
+                memory_resource*    mem;
+                char                pad[LINE - 3 * sizeof(void*)];
+            };
+
+            struct side_
+            {
+                size_t              pos;        // own index
+                size_t              seen;       // the other side's, cached
+                char                pad[LINE - 2 * sizeof(size_t)];
+            };
+
+            shared_ s_;
+            side_   c_;         // consumer, pos is the head
+            side_   p_;         // producer, pos is the tail
+
+            // not copyable, the elements are in flight between two threads
+            spsc_buffer(const spsc_buffer&);
+            spsc_buffer& operator= (const spsc_buffer&);
+
+#ifdef FRAMEWORK_CXX11
+            static_assert(!overwrite || std::is_trivially_copyable<T>::value,
+                          "overwrite needs a trivially copyable element type");
+#endif
+
+            static inline size_t load_(const size_t& x)
+            {
+                return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+            }
+
+            static inline void store_(size_t& x, size_t v)
+            {
+                __atomic_store_n(&x, v, __ATOMIC_RELEASE);
+            }
+
+            static inline bool claim_(size_t& x, size_t h)
+            {
+                return __atomic_compare_exchange_n(&x, &h, h + 1, false,
+                                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+            }
+
+        public:
+            explicit spsc_buffer(size_t capacity)
+            {
+                size_t n = 1;
+                while (n < capacity) n <<= 1;
+                s_.mem  = default_resource();
+                s_.ring = aligned_new<T>(n, s_.mem);
+                s_.mask = n - 1;
+                c_.pos  = c_.seen = 0;
+                p_.pos  = p_.seen = 0;
+            }
+
+            ~spsc_buffer()
+            {
+                aligned_delete(s_.ring, s_.mask + 1, s_.mem);
+            }
+
+            inline size_t capacity(void) const
+            {
+                return s_.mask + 1;
+            }
+
+            // exact only when neither side is running
+            inline size_t occupied(void) const
+            {
+                size_t h = load_(c_.pos);
+                size_t t = load_(p_.pos);
+                return (t > h) ? t - h : 0;
+            }
+
+            inline bool empty(void) const
+            {
+                return occupied() == 0;
+            }
+
+            // producer side, false if the ring is full
+            inline bool try_push(const T& e)
+            {
+                size_t t = p_.pos;
+                if (t - p_.seen > s_.mask) {
+                    p_.seen = load_(c_.pos);
+                    if (t - p_.seen > s_.mask)
+                        return false;
+                }
+                s_.ring[t & s_.mask] = e;
+                store_(p_.pos, t + 1);
+                return true;
+            }
+
+            // producer side. with overwrite the oldest element is dropped
+            // if the ring is full and it always succeeds, otherwise the
+            // same as try_push
+            inline bool push(const T& e)
+            {
+                if (!overwrite)
+                    return try_push(e);
+                size_t t = p_.pos;
+                if (t - p_.seen > s_.mask) {
+                    p_.seen = load_(c_.pos);
+                    // a failure means the consumer just freed the slot
+                    if ((t - p_.seen > s_.mask) && claim_(c_.pos, p_.seen))
+                        p_.seen++;
+                }
+                s_.ring[t & s_.mask] = e;
+                store_(p_.pos, t + 1);
+                return true;
+            }
+
+            // consumer side, false if the ring is empty
+            inline bool try_pop(T& e)
+            {
+                if (!overwrite) {
+                    size_t h = c_.pos;
+                    if (h == c_.seen) {
+                        c_.seen = load_(p_.pos);
+                        if (h == c_.seen)
+                            return false;
+                    }
+                    e = s_.ring[h & s_.mask];
+                    store_(c_.pos, h + 1);
+                    return true;
+                }
+                for (;;) {
+                    size_t h = load_(c_.pos);
+                    if (h >= c_.seen) {
+                        c_.seen = load_(p_.pos);
+                        if (h >= c_.seen)
+                            return false;
+                    }
+                    T v = s_.ring[h & s_.mask];
+                    if (claim_(c_.pos, h)) {
+                        e = v;
+                        return true;
+                    }
+                }
+            }
+
+    }; // class spsc_buffer<T, overwrite>
+
+} // namespace framework
+
+#endif // __SPSC_H__
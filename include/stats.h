@@ -0,0 +1,384 @@
+//
+// stats.h
+//
+// buffer keeping running statistics of its occupied elements
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "array.h"
+#include "buffer.h"
+
+namespace framework
+{
+    struct stats_less_    { template <typename T> bool operator() (const T& a, const T& b) const { return a < b; } };
+    struct stats_greater_ { template <typename T> bool operator() (const T& a, const T& b) const { return b < a; } };
+
+    // candidates for the extreme of a sliding window with their sequence
+    // numbers, in order of arrival. an arriving value drops every
+    // candidate at the back it beats since those leave the window first,
+    // so the front is the extreme and each value is pushed and dropped at
+    // most once.
+    template <typename T, typename Beats>
+    class window_extreme_
+    {
+        private:
+            struct entry
+            {
+                T       v;
+                size_t  seq;
+            };
+
+            std::vector<entry>  ring_;
+            size_t              head_;
+            size_t              n_;
+
+            inline size_t at_(size_t i) const
+            {
+                i += head_;
+                return (i >= ring_.size()) ? i - ring_.size() : i;
+            }
+
+        public:
+            window_extreme_() : ring_(1), head_(0), n_(0) {}
+
+            inline void reset(size_t capacity)
+            {
+                ring_.assign(capacity ? capacity : 1, entry());
+                head_ = 0;
+                n_    = 0;
+            }
+
+            inline void push(const T& v, size_t seq)
+            {
+                while (n_ && !Beats()(ring_[at_(n_ - 1)].v, v))
+                    n_--;
+                entry e = { v, seq };
+                ring_[at_(n_++)] = e;
+            }
+
+            // seq leaves the window
+            inline void evict(size_t seq)
+            {
+                if (n_ && (ring_[head_].seq == seq)) {
+                    if (++head_ == ring_.size()) head_ = 0;
+                    n_--;
+                }
+            }
+
+            inline const T& front(void) const
+            {
+                return ring_[head_].v;
+            }
+
+    }; // class window_extreme_<T, Beats>
+
+    // buffer used as a sliding window. every element entering or leaving,
+    // by push or by the oldest being overwritten or popped, updates the
+    // count, sum, mean and variance (Welford, the leaving value is
+    // subtracted back out) and the min/max candidates in O(1). rounding
+    // accumulates over very long runs, refresh() recomputes the moments.
+    // the buffer is a private base, so nothing changes the elements past
+    // the statistics: they are read through const access or window().
+    //
+    // quantiles are exact by selection over a copy, or read from a
+    // histogram of fixed bins over [lo, hi) kept up to date the same way
+    // when one is set, approximate to a bin width.
+    template <typename T, typename A = double>
+    class stats_buffer : private buffer<T>
+    {
+        private:
+            size_t                              in_;        // sequence of the next push
+            A                                   sum_;
+            A                                   mean_;
+            A                                   m2_;        // sum of squared deviations
+            window_extreme_<T, stats_less_>     min_;
+            window_extreme_<T, stats_greater_>  max_;
+            std::vector<size_t>                 bins_;
+            A                                   lo_, scale_;
+
+        public:
+            typedef typename buffer<T>::const_iterator  const_iterator;
+
+            using buffer<T>::size;
+            using buffer<T>::occupied;
+            using buffer<T>::head;
+            using buffer<T>::policy;
+            using buffer<T>::overwritten;
+
+            stats_buffer() : buffer<T>()
+            {
+                reset_();
+            }
+
+            explicit stats_buffer(size_t s1) : buffer<T>(s1)
+            {
+                reset_();
+            }
+
+            inline void set_size(size_t s1)
+            {
+                buffer<T>::set_size(s1);
+                reset_();
+            }
+
+            inline void resize(size_t s1)
+            {
+                buffer<T>::resize(s1);
+                reset_();
+            }
+
+            inline virtual void clear()
+            {
+                buffer<T>::clear();
+                reset_();
+            }
+
+            // the window, to read as a buffer
+            inline const buffer<T>& window(void) const
+            {
+                return *this;
+            }
+
+            inline const T& operator[] (size_t idx) const
+            {
+                return buffer<T>::operator[](idx);
+            }
+
+            inline const T& at(size_t idx) const
+            {
+                return buffer<T>::at(idx);
+            }
+
+            inline const_iterator begin(void) const
+            {
+                return buffer<T>::begin();
+            }
+
+            inline const_iterator end(void) const
+            {
+                return buffer<T>::end();
+            }
+
+            inline buffer_span<const T> peek(void) const
+            {
+                return buffer<T>::peek();
+            }
+
+            // bins of equal width over [lo, hi), values outside go to the
+            // first or the last one
+            inline void set_histogram(A lo, A hi, size_t bins)
+            {
+                if (!bins || !(lo < hi))
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                bins_.assign(bins, 0);
+                lo_    = lo;
+                scale_ = static_cast<A>(bins) / (hi - lo);
+                for (size_t i = 0; i < this->occupied(); i++)
+                    bins_[bin_(buffer<T>::operator[](i))]++;
+            }
+
+            inline virtual bool push(const T e)
+            {
+                size_t n = this->occupied();
+                if (n && (n == this->size()))
+                    remove_(buffer<T>::operator[](0), in_ - n, n - 1);
+                buffer<T>::push(e);
+                add_(e);
+                return true;
+            }
+
+            template <typename T2>
+            inline void push(const T2* p, size_t n)
+            {
+                for (size_t i = 0; i < n; i++)
+                    push(static_cast<T>(p[i]));
+            }
+
+            inline T pop(void)
+            {
+                size_t seq = in_ - this->occupied();
+                T v = buffer<T>::pop();
+                remove_(v, seq, this->occupied());
+                return v;
+            }
+
+            template <typename T2>
+            inline size_t pop(T2* d, size_t n)
+            {
+                if (n > this->occupied()) n = this->occupied();
+                for (size_t i = 0; i < n; i++)
+                    d[i] = static_cast<T2>(pop());
+                return n;
+            }
+
+            inline void consume(size_t n)
+            {
+                if (n > this->occupied())
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                while (n--)
+                    pop();
+            }
+
+            inline A sum(void) const
+            {
+                return sum_;
+            }
+
+            inline A mean(void) const
+            {
+                return mean_;
+            }
+
+            // of the population
+            inline A variance(void) const
+            {
+                size_t n = this->occupied();
+                return n ? m2_ / static_cast<A>(n) : A();
+            }
+
+            inline A stddev(void) const
+            {
+                return std::sqrt(variance());
+            }
+
+            inline T min_value(void) const
+            {
+                if (!this->occupied())
+                    throw(array_exception(array_exception::EMPTY));
+                return min_.front();
+            }
+
+            inline T max_value(void) const
+            {
+                if (!this->occupied())
+                    throw(array_exception(array_exception::EMPTY));
+                return max_.front();
+            }
+
+            // q in [0, 1]. with a histogram, interpolated inside the bin
+            // of rank q * n and kept within [min, max]
+            inline A quantile(double q) const
+            {
+                size_t n = this->occupied();
+                if (!n)
+                    throw(array_exception(array_exception::EMPTY));
+                if ((q < 0) || (q > 1))
+                    throw(array_exception(array_exception::OUT_OF_RANGE));
+                if (bins_.empty()) {
+                    std::vector<T> v(this->begin(), this->end());
+                    size_t k = static_cast<size_t>(q * (n - 1) + 0.5);
+                    std::nth_element(v.begin(), v.begin() + k, v.end());
+                    return static_cast<A>(v[k]);
+                }
+                A rank = static_cast<A>(q * n), seen = 0;
+                size_t b = 0;
+                for (; b + 1 < bins_.size(); b++) {
+                    if (seen + bins_[b] > rank) break;
+                    seen += bins_[b];
+                }
+                A x = lo_ + (b + (bins_[b] ? (rank - seen) / bins_[b] : A())) / scale_;
+                x = std::max(x, static_cast<A>(min_.front()));
+                return std::min(x, static_cast<A>(max_.front()));
+            }
+
+            // recomputes sum, mean and variance from the contents
+            inline void refresh(void)
+            {
+                size_t n = this->occupied();
+                sum_ = mean_ = m2_ = A();
+                for (size_t i = 0; i < n; i++)
+                    sum_ += static_cast<A>(buffer<T>::operator[](i));
+                if (!n) return;
+                mean_ = sum_ / static_cast<A>(n);
+                for (size_t i = 0; i < n; i++) {
+                    A d = static_cast<A>(buffer<T>::operator[](i)) - mean_;
+                    m2_ += d * d;
+                }
+            }
+
+        private:
+            inline void reset_(void)
+            {
+                in_   = 0;
+                sum_  = mean_ = m2_ = A();
+                min_.reset(this->size());
+                max_.reset(this->size());
+                bins_.clear();
+                lo_   = scale_ = A();
+            }
+
+            inline size_t bin_(const T& v) const
+            {
+                A x = (static_cast<A>(v) - lo_) * scale_;
+                if (!(x > 0)) return 0;
+                size_t b = static_cast<size_t>(x);
+                return (b < bins_.size()) ? b : bins_.size() - 1;
+            }
+
+            // after e is stored
+            inline void add_(const T& e)
+            {
+                A x = static_cast<A>(e);
+                size_t n = this->occupied();
+                A d = x - mean_;
+                sum_  += x;
+                mean_ += d / static_cast<A>(n);
+                m2_   += d * (x - mean_);
+                min_.push(e, in_);
+                max_.push(e, in_);
+                in_++;
+                if (!bins_.empty()) bins_[bin_(e)]++;
+            }
+
+            // the oldest e, of sequence seq, leaves and n elements stay
+            inline void remove_(const T& e, size_t seq, size_t n)
+            {
+                A x = static_cast<A>(e);
+                if (!n) {
+                    sum_ = mean_ = m2_ = A();
+                } else {
+                    A d = x - mean_;
+                    sum_  -= x;
+                    mean_ -= d / static_cast<A>(n);
+                    m2_   -= d * (x - mean_);
+                    if (m2_ < A()) m2_ = A();
+                }
+                min_.evict(seq);
+                max_.evict(seq);
+                if (!bins_.empty()) bins_[bin_(e)]--;
+            }
+
+    }; // class stats_buffer<T, A>
+
+    // the running values instead of a pass over the elements
+
+    template <typename T, typename A>
+    inline T sum(const stats_buffer<T, A>& sb)
+    {
+        return static_cast<T>(sb.sum());
+    }
+
+    template <typename T, typename A>
+    inline T min_value(const stats_buffer<T, A>& sb)
+    {
+        return sb.min_value();
+    }
+
+    template <typename T, typename A>
+    inline T max_value(const stats_buffer<T, A>& sb)
+    {
+        return sb.max_value();
+    }
+
+} // namespace framework
+
+#endif // __STATS_H__
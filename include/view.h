@@ -0,0 +1,229 @@
+//
+// view.h
+//
+// slices, sub-blocks, transposes and reshapes of array_ref
+//
+// Jinserk Baik <jinserk.baik@gmail.com>
+// copyright (c) 2011, all rights reserved.
+//
+
+#ifndef __VIEW_H__
+#define __VIEW_H__
+
+#include "array.h"
+
+namespace framework
+{
+    // every view borrows the storage of the ref it's made from and only
+    // rearranges extents and strides, so none of them allocates.
+
+    // fixes one axis at idx, e.g. slice(R, 1, j) is the j-th column
+    template <typename T, size_t dim, typename Access>
+    inline array_ref<T, dim-1, Access>
+    slice(const array_ref<T, dim, Access>& r, size_t axis, size_t idx)
+    {
+        if (axis >= dim)
+            throw(array_exception(array_exception::DIM_ERROR));
+        Access::check(idx, r.size(axis), r.data());
+        size_t ext[dim-1], stride[dim-1];
+        for (size_t k = 0, j = 0; k < dim; k++) {
+            if (k == axis) continue;
+            ext[j]    = r.size(k);
+            stride[j] = r.stride(k);
+            j++;
+        }
+        return array_ref<T, dim-1, Access>(r.data() + idx * r.stride(axis), ext, stride);
+    }
+
+    // keeps every step-th index in [begin, end) of one axis
+    template <typename T, size_t dim, typename Access>
+    inline array_ref<T, dim, Access>
+    range(const array_ref<T, dim, Access>& r, size_t axis,
+          size_t begin, size_t end, size_t step = 1)
+    {
+        if ((axis >= dim) || !step)
+            throw(array_exception(array_exception::DIM_ERROR));
+        if ((begin > end) || (end > r.size(axis)))
+            throw(array_exception(array_exception::OUT_OF_RANGE));
+        size_t ext[dim], stride[dim];
+        for (size_t k = 0; k < dim; k++) {
+            ext[k]    = r.size(k);
+            stride[k] = r.stride(k);
+        }
+        ext[axis]     = (end - begin + step - 1) / step;
+        stride[axis] *= step;
+        return array_ref<T, dim, Access>(r.data() + begin * r.stride(axis), ext, stride);
+    }
+
+    template <typename T, typename Access>
+    inline array_ref<T, 2, Access>
+    block(const array_ref<T, 2, Access>& r, size_t i, size_t j, size_t n1, size_t n2)
+    {
+        return range(range(r, 0, i, i + n1), 1, j, j + n2);
+    }
+
+    template <typename T, typename Access>
+    inline array_ref<T, 3, Access>
+    block(const array_ref<T, 3, Access>& r, size_t i, size_t j, size_t k,
+          size_t n1, size_t n2, size_t n3)
+    {
+        return range(range(range(r, 0, i, i + n1), 1, j, j + n2), 2, k, k + n3);
+    }
+
+    // swaps two axes, by default the first and the last one
+    template <typename T, size_t dim, typename Access>
+    inline array_ref<T, dim, Access>
+    transpose(const array_ref<T, dim, Access>& r, size_t a0 = 0, size_t a1 = dim - 1)
+    {
+        if ((a0 >= dim) || (a1 >= dim))
+            throw(array_exception(array_exception::DIM_ERROR));
+        size_t ext[dim], stride[dim];
+        for (size_t k = 0; k < dim; k++) {
+            ext[k]    = r.size(k);
+            stride[k] = r.stride(k);
+        }
+        std::swap(ext[a0], ext[a1]);
+        std::swap(stride[a0], stride[a1]);
+        return array_ref<T, dim, Access>(r.data(), ext, stride);
+    }
+
+    template <typename T, size_t dim, typename Access>
+    inline bool is_contiguous(const array_ref<T, dim, Access>& r)
+    {
+        size_t s = 1;
+        for (size_t k = dim; k > 0; k--) {
+            if ((r.size(k-1) > 1) && (r.stride(k-1) != s))
+                return false;
+            s *= r.size(k-1);
+        }
+        return true;
+    }
+
+    // new extents over the same elements, only for contiguous refs
+    template <size_t dim2, typename T, size_t dim, typename Access>
+    inline array_ref<T, dim2, Access>
+    reshape_ref_(const array_ref<T, dim, Access>& r, const size_t* ext)
+    {
+        size_t n1 = 1, n2 = 1, stride[dim2];
+        for (size_t k = 0; k < dim; k++)
+            n1 *= r.size(k);
+        for (size_t k = 0; k < dim2; k++)
+            n2 *= ext[k];
+        if ((n1 != n2) || !is_contiguous(r))
+            throw(array_exception(array_exception::DIM_ERROR));
+        stride[dim2-1] = 1;
+        for (size_t k = dim2-1; k > 0; k--)
+            stride[k-1] = stride[k] * ext[k];
+        return array_ref<T, dim2, Access>(r.data(), ext, stride);
+    }
+
+    template <typename T, size_t dim, typename Access>
+    inline array_ref<T, 1, Access>
+    reshape(const array_ref<T, dim, Access>& r, size_t s1)
+    {
+        size_t ext[] = { s1 };
+        return reshape_ref_<1>(r, ext);
+    }
+
+    template <typename T, size_t dim, typename Access>
+    inline array_ref<T, 2, Access>
+    reshape(const array_ref<T, dim, Access>& r, size_t s1, size_t s2)
+    {
+        size_t ext[] = { s1, s2 };
+        return reshape_ref_<2>(r, ext);
+    }
+
+    template <typename T, size_t dim, typename Access>
+    inline array_ref<T, 3, Access>
+    reshape(const array_ref<T, dim, Access>& r, size_t s1, size_t s2, size_t s3)
+    {
+        size_t ext[] = { s1, s2, s3 };
+        return reshape_ref_<3>(r, ext);
+    }
+
+    // the same views taken straight from an array
+
+    template <typename T, size_t dim>
+    inline array_ref<T, dim-1> slice(array<T, dim>& ar, size_t axis, size_t idx)
+    {
+        return slice(ar.ref(), axis, idx);
+    }
+
+    template <typename T, size_t dim>
+    inline array_ref<T, dim>
+    range(array<T, dim>& ar, size_t axis, size_t begin, size_t end, size_t step = 1)
+    {
+        return range(ar.ref(), axis, begin, end, step);
+    }
+
+    template <typename T>
+    inline array_ref<T, 2>
+    block(array<T, 2>& ar, size_t i, size_t j, size_t n1, size_t n2)
+    {
+        return block(ar.ref(), i, j, n1, n2);
+    }
+
+    template <typename T>
+    inline array_ref<T, 3>
+    block(array<T, 3>& ar, size_t i, size_t j, size_t k, size_t n1, size_t n2, size_t n3)
+    {
+        return block(ar.ref(), i, j, k, n1, n2, n3);
+    }
+
+    template <typename T, size_t dim>
+    inline array_ref<T, dim> transpose(array<T, dim>& ar, size_t a0 = 0, size_t a1 = dim - 1)
+    {
+        return transpose(ar.ref(), a0, a1);
+    }
+
+    template <typename T, size_t dim>
+    inline array_ref<T, 1> reshape(array<T, dim>& ar, size_t s1)
+    {
+        return reshape(ar.ref(), s1);
+    }
+
+    template <typename T, size_t dim>
+    inline array_ref<T, 2> reshape(array<T, dim>& ar, size_t s1, size_t s2)
+    {
+        return reshape(ar.ref(), s1, s2);
+    }
+
+    template <typename T, size_t dim>
+    inline array_ref<T, 3> reshape(array<T, dim>& ar, size_t s1, size_t s2, size_t s3)
+    {
+        return reshape(ar.ref(), s1, s2, s3);
+    }
+
+    template <typename T, size_t dim, typename Access>
+    inline void write_text(text_writer& w, const array_ref<T, dim, Access>& r)
+    {
+        size_t sz = r.size();
+        if (!sz)
+            w.empty();
+        for (size_t i = 0; i < sz; i++) {
+            write_text(w, r[i]);
+            w.row();
+        }
+    }
+
+    template <typename T, typename Access>
+    inline void write_text(text_writer& w, const array_ref<T, 1, Access>& r)
+    {
+        size_t sz = r.size();
+        if (!sz)
+            w.empty();
+        for (size_t i = 0; i < sz; i++) {
+            w.put(r[i]);
+            w.separator();
+        }
+    }
+
+    template <typename T, size_t dim, typename Access>
+    inline std::ostream& operator<< (std::ostream& os, const array_ref<T, dim, Access>& r)
+    {
+        return print(os, r);
+    }
+
+} // namespace framework
+
+#endif // __VIEW_H__
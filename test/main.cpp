@@ -4,6 +4,12 @@
 
 #include <iostream>
 #include <iomanip>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <sstream>
+
+#include <sys/wait.h>
 
 #include "framework.h"
 
@@ -13,12 +19,62 @@ using namespace framework;
 void test_logstream(void);
 void test_array(void);
 void test_buffer(void);
+void test_layout(void);
+void test_access(void);
+void test_expression(void);
+void test_numeric(void);
+void test_move(void);
+void test_view(void);
+void test_mapped(void);
+void test_serialize(void);
+void test_format(void);
+void test_parallel(void);
+void test_linalg(void);
+void test_fixed(void);
+void test_memory(void);
+void test_assign(void);
+void test_iterator(void);
+void test_sparse(void);
+void test_spsc(void);
+void test_mpmc(void);
+void test_batch(void);
+void test_mirrored(void);
+void test_stats(void);
+void test_shm(void);
+void test_policy(void);
+void test_async_log(void);
+void test_mt_log(void);
 
 int main(int argc, char* argv[], char* envp[])
 {
     //test_logstream();
     test_array();
     test_buffer();
+    test_layout();
+    test_access();
+    test_expression();
+    test_numeric();
+    test_move();
+    test_view();
+    test_mapped();
+    test_serialize();
+    test_format();
+    test_parallel();
+    test_linalg();
+    test_fixed();
+    test_memory();
+    test_assign();
+    test_iterator();
+    test_sparse();
+    test_spsc();
+    test_mpmc();
+    test_batch();
+    test_mirrored();
+    test_stats();
+    test_shm();
+    test_policy();
+    test_async_log();
+    test_mt_log();
 
     return 0;
 }
@@ -132,3 +188,1392 @@ void test_buffer(void)
         SHOW(e);
     }
 }
+
+void test_layout(void)
+{
+    array<int, 3> A(2, 3, 4);
+
+    for (int i = 0; i < 24; ++i)
+        A.push(i);
+
+    cout << A.size(0) << " " << A.size(1) << " " << A.size(2) << endl;
+    cout << (&A[1][2][3] == A.data() + 23) << " "
+         << (reinterpret_cast<size_t>(A.data()) % ARRAY_ALIGNMENT) << endl;
+
+    array<int, 3> B;
+    B = A;
+    B[1][0][0] = -1;
+    cout << B[1] << A[1][0] << endl;
+
+    try {
+        B[0][1].resize(8);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+
+    B.resize(2, 2, 2);
+    B = 1, 2, 3, 4, 5, 6, 7, 8;
+    cout << B.data()[7] << endl;
+}
+
+void test_access(void)
+{
+    array<float, 2> A(3, 4);
+    for (int i = 0; i < 12; ++i)
+        A.push(i * .5f);
+
+    array_ref<float, 2, unchecked_access> U = A.unchecked();
+    float sum = 0.f;
+    for (size_t i = 0; i < U.size(0); ++i)
+        for (size_t j = 0; j < U.size(1); ++j)
+            sum += U[i][j];
+    cout << sum << " " << U[2][3] << endl;
+
+    try {
+        A.checked()[1][4] = 0.f;
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+
+    buffer<int> B(4);
+    for (int i = 0; i < 6; ++i)
+        B.push(i);
+    buffer_ref<int, unchecked_access> R = B.unchecked();
+    for (size_t i = 0; i < R.size(); ++i)
+        cout << R[i] << ' ';
+    cout << endl;
+
+    try {
+        B.checked()[4] = 0;
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_expression(void)
+{
+    array<float, 2> A(2, 3), B(2, 3), C;
+    array<int, 2> D(2, 3);
+
+    A = 1, 2, 3, 4, 5, 6;
+    B = 6, 5, 4, 3, 2, 1;
+    D = 1, 1, 1, 2, 2, 2;
+
+    C = A * B + 2 * D;
+    cout << C;
+
+    array<double, 1> E(4), F;
+    E = 1, 4, 9, 16;
+    F = sqrt(E) - E / 2. + abs(-E);
+    cout << F << endl;
+
+    try {
+        array<float, 2> G(3, 2);
+        C = A + G;
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_numeric(void)
+{
+    array<int, 1> I(37);
+    for (int i = 0; i < 37; ++i)
+        I.push(i - 18);
+
+    for (int l = simd::AVX2; l >= simd::SCALAR; --l) {
+        simd::set_level(l);
+
+        array<float, 1> F(I);
+        array<double, 1> D(F);
+        array<int, 1> J(D);
+
+        fill(F, 0.5);
+        axpy(2, D, D);
+        cout << sum(J) << " " << min_value(D) << " " << max_value(D) << " "
+             << dot(D, D) << " " << sum(F) << endl;
+    }
+    simd::set_level(simd::detect());
+
+    buffer<double> B(8);
+    for (int i = 0; i < 11; ++i)
+        B.push(i);
+    cout << sum(B) << " " << min_value(B) << " " << max_value(B) << endl;
+
+    try {
+        array<float, 2> E;
+        min_value(E);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+array<float, 2> make_grid(size_t s1, size_t s2)
+{
+    array<float, 2> G(s1, s2);
+    fill(G, 1);
+    return G;
+}
+
+void test_move(void)
+{
+    array<float, 2> A = make_grid(3, 4);
+    A = make_grid(2, 2);
+    cout << A.size(0) << "x" << A.size(1) << " " << sum(A) << endl;
+
+    array<float, 2> B(4, 4);
+    B = A;
+    const float* q = B.data();
+    B = make_grid(3, 5);
+    cout << (B.data() == q) << " " << sum(B) << endl;
+
+    std::vector< array<float, 2> > V;
+    for (int i = 0; i < 4; ++i)
+        V.push_back(make_grid(i + 1, 2));
+    cout << V.size() << " " << sum(V[3]) << endl;
+
+    swap(A, B);
+    cout << A.size(0) << " " << B.size(0) << endl;
+
+#ifdef FRAMEWORK_CXX11
+    array<float, 2> C(std::move(A));
+    cout << (A.data() == NULL) << " " << C.size(1) << endl;
+
+    buffer<int> D(4);
+    D.push(1); D.push(2);
+    buffer<int> E(std::move(D));
+    cout << E << D.occupied() << endl;
+
+    // a bound row is copied, so moving from it may allocate and throw
+    array<float, 1> R(std::move(C[1]));
+    cout << (R.data() != C[1].data()) << " " << (R[0] == C[1][0]) << " "
+         << std::is_nothrow_move_constructible< array<float, 2> >::value
+         << std::is_nothrow_move_constructible< buffer<int> >::value << endl;
+#endif
+}
+
+void test_view(void)
+{
+    array<int, 2> A(3, 4);
+    A = 1, 2, 3, 4,
+        5, 6, 7, 8,
+        9, 10, 11, 12;
+
+    cout << slice(A, 1, 2) << endl;
+    cout << block(A, 1, 1, 2, 3);
+    cout << transpose(A);
+    cout << range(A, 1, 0, 4, 2);
+
+    array_ref<int, 2> T = transpose(A);
+    T[3][0] = -4;
+    cout << A[0] << endl;
+
+    array<int, 3> B(2, 2, 3);
+    for (int i = 0; i < 12; ++i)
+        B.push(i);
+    cout << reshape(B, 3, 4)[2] << " " << slice(B, 2, 1)[1] << endl;
+
+    try {
+        reshape(transpose(A), 12);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_mapped(void)
+{
+    array<float, 2> A(3, 4);
+    for (int i = 0; i < 12; ++i)
+        A.push(i * .25f);
+
+    {
+        mapped_array<float, 2> W("mapped.bin", mapped_file::READ_WRITE, 3, 4);
+        W = A;
+        W[2][3] = 9.f;
+        W.sync();
+    }
+
+    mapped_array<float, 2> R("mapped.bin", mapped_file::READ_ONLY, 3, 4);
+    mapped_array<float, 1> F;
+    size_t ext[] = { 0 };
+    F.map("mapped.bin", mapped_file::READ_ONLY, ext, 4 * sizeof(float));
+
+    array<float, 2>& B = R;
+    cout << B[1] << B[2][3] << " " << F.size() << " " << F[0] << endl;
+
+    try {
+        R.set_size(4, 4);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+
+    try {
+        mapped_array<float, 1> M("no/such/file", mapped_file::READ_ONLY, 10);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+    unlink("mapped.bin");
+}
+
+// the first use of the scalar crc32c builds its table
+void* crc_scalar_run(void* arg)
+{
+    *static_cast<uint32_t*>(arg) = ~crc32c_scalar_(~0u, reinterpret_cast<const unsigned char*>("123456789"), 9);
+    return NULL;
+}
+
+void test_serialize(void)
+{
+    array<double, 2> A(2, 3), B;
+    A = 1, 2, 3, 4, 5, 6;
+
+    std::stringstream ss;
+    serialize(ss, A);
+    deserialize(ss, B);
+    cout << B.size(0) << "x" << B.size(1) << " " << B[1];
+
+    buffer<int> C(4), D;
+    for (int i = 0; i < 6; ++i)
+        C.push(i);
+    ss.str("");
+    serialize(ss, C);
+    deserialize(ss, D);
+    cout << D.size() << " " << D << endl;
+
+    unlink("stream.bin");
+    size_t inner[] = { 3 };
+    {
+        array_writer<double> W("stream.bin", 2, inner);
+        W.append(A);
+    }
+    {
+        array_writer<double> W("stream.bin", 2, inner);
+        W.append(A[1].data(), 3);
+        cout << W.count() << " ";
+    }
+
+    array_reader<double> R("stream.bin");
+    array<double, 1> chunk;
+    R.next(chunk);
+    std::streamoff pos = R.tell();
+    R.next(chunk);
+    R.seek(pos);
+    array<double, 2> E;
+    R.read_all(E);
+    cout << chunk.size() << " " << E.size(0) << " " << E[0] << endl;
+
+    std::string s = ss.str();
+    s[s.size() - 1] ^= 1;
+    std::stringstream bad(s);
+    try {
+        deserialize(bad, D);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+
+    // a chunk count past the end of the data is refused before allocating
+    std::fstream fs("stream.bin", std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t huge = uint64_t(1) << 60;
+    fs.seekp(binary_header::SIZE + 8);
+    fs.write(reinterpret_cast<const char*>(&huge), 8);
+    fs.close();
+    array_reader<double> R2("stream.bin");
+    try {
+        R2.next(chunk);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+    unlink("stream.bin");
+
+    // threads racing to build the crc table all see it whole
+    pthread_t t[4];
+    uint32_t crc[4];
+    for (int k = 0; k < 4; ++k)
+        pthread_create(&t[k], NULL, crc_scalar_run, &crc[k]);
+    for (int k = 0; k < 4; ++k)
+        pthread_join(t[k], NULL);
+    cout << hex << crc[0] << " " << (crc[0] == crc[1] && crc[1] == crc[2] && crc[2] == crc[3])
+         << " " << crc32c("123456789", 9) << dec << endl;
+}
+
+void test_format(void)
+{
+    array<int, 2> A(2, 3);
+    A = 1, -20, 300, -4000, 50000, -600000;
+
+    print(cout, A, text_format(", ", ";\n"));
+    cout << setfill('.') << internal << setw(8) << A[1] << left << setw(4) << A[0] << endl;
+
+    array<double, 1> B(3);
+    B = 1. / 3, -2.5e-7, 12345.678;
+    cout << right << scientific << setprecision(3) << setw(11) << B << endl;
+    print(cout, B, text_format("|").precision(1).width(0));
+    cout << endl;
+
+    array<int, 1> E;
+    cout << setw(3) << setfill('*') << E << endl;
+    cout.copyfmt(std::ios(NULL));
+}
+
+struct mark_diagonal
+{
+    array<float, 3>& A;
+
+    void operator() (size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; ++i)
+            A[i][i % 128][i % 96] = float(i);
+    }
+};
+
+struct twice
+{
+    float operator() (float x) { return 2.f * x; }
+};
+
+struct accumulate
+{
+    double operator() (double s, double x) { return s + x; }
+};
+
+void test_parallel(void)
+{
+    array<float, 3> A(64, 128, 96), B(64, 128, 96);
+    parallel_fill(A, .1f);
+    mark_diagonal m = { A };
+    parallel_for(A, m);
+    parallel_transform(A, B, twice());
+
+    double s1 = parallel_reduce(B, 0., accumulate());
+    double s2 = parallel_reduce(B, 0., accumulate());
+    cout << (thread_pool::global().size() > 0) << " " << (s1 == s2) << " "
+         << std::setprecision(9) << s1 << endl;
+
+    try {
+        array<float, 3> C(64, 128, 95);
+        parallel_transform(A, C, twice());
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_linalg(void)
+{
+    array<double, 2> A(3, 3), B(3, 2), C;
+    A = 4, 2, 2,
+        2, 5, 3,
+        2, 3, 6;
+    B = 1, 0,
+        0, 1,
+        1, 1;
+
+    cout.copyfmt(std::ios(NULL));
+    gemm(1, A, B, 0, C);
+    cout << C;
+
+    array<double, 2> D(2, 3);
+    gemm(2., transpose(B.ref()), A.ref(), 0., D.ref());
+    cout << D << endl;
+
+    array<double, 1> x(3), y;
+    x = 1, 1, 1;
+    gemv(1, A, x, 0, y);
+    cout << y << endl;
+
+    array<double, 2> L = A;
+    cholesky(L);
+    array<double, 1> b = y;
+    cholesky_solve(L, b);
+    cout << L[1] << b << endl;
+
+    array<double, 2> LU = A;
+    array<size_t, 1> piv;
+    lu(LU, piv);
+    b = y;
+    lu_solve(LU, piv, b);
+    cout << piv << b << endl;
+
+    array<int, 2> T(2, 3), U;
+    T = 1, 2, 3, 4, 5, 6;
+    transpose_copy(T, U);
+    cout << U;
+
+    // several blocks of rows on the pool and several panels of k, both
+    // with a ragged end, against the plain product
+    size_t m = 300, k = 600, n = 50;
+    array<double, 2> P(m, k), Q(k, n), R;
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = 0; j < k; j++) P[i][j] = (i + 2 * j) % 7;
+    for (size_t i = 0; i < k; i++)
+        for (size_t j = 0; j < n; j++) Q[i][j] = (3 * i + j) % 5;
+    gemm(1, P, Q, 0, R);
+    double err = 0;
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = 0; j < n; j++) {
+            double t = 0;
+            for (size_t p = 0; p < k; p++) t += P[i][p] * Q[p][j];
+            err = std::max(err, std::abs(R[i][j] - t));
+        }
+    cout << err << endl;
+
+    try {
+        array<double, 2> S(2, 2);
+        S = 1, 2, 2, 4;
+        lu(S, piv);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_fixed(void)
+{
+    fixed_array<float, 3, 3> A, B;
+    const float a[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    A.assign(a);
+    B.fill(1.f);
+    B[1][1] = 2.f;
+
+    fixed_array<float, 3, 3> C = matmul(A, B) - 2.f * A;
+    cout << C << transpose(C);
+
+    char shape[fixed_array<int, 2, 3, 4>::SIZE];
+#ifdef FRAMEWORK_CXX11
+    static_assert(fixed_array<float, 4, 4>::size(1) == 4, "constexpr extent");
+#endif
+    cout << sizeof(shape) << " " << sizeof(fixed_array<double, 4, 4>) << " "
+         << fixed_array<int, 2, 3, 4>::size(2) << " " << simd::sum(A[2], 3) << endl;
+
+    fixed_array<int, 4> D;
+    D.fill(3);
+    D *= 2;
+    cout << D << (D == D * 1) << endl;
+
+    try {
+        D.at(4) = 0;
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_memory(void)
+{
+    arena_resource arena(4096);
+    {
+        resource_scope scope(&arena);
+        array<float, 3> A(4, 5, 6);
+        array<int, 1> B(100);
+        fill(A, 1);
+        cout << (A.resource() == &arena) << " " << (B.resource() == &arena) << " "
+             << sum(A) << " " << (reinterpret_cast<size_t>(A.data()) % ARRAY_ALIGNMENT) << endl;
+    }
+    arena.reset();
+
+    pool_resource pool;
+    buffer<double> C;
+    C.set_resource(&pool);
+    C.set_size(8);
+    for (int i = 0; i < 12; ++i)
+        C.push(i);
+    buffer<double> D(C);
+    cout << (C.resource() == &pool) << " " << (D.resource() == &pool) << " " << sum(C) << endl;
+
+    array<float, 2> E;
+    E.set_resource(&huge_page_resource::global());
+    E.set_size(1024, 1024);
+    fill(E, 2);
+    cout << (reinterpret_cast<size_t>(E.data()) % huge_page_resource::HUGE_PAGE) << " "
+         << sum(E) << endl;
+
+    try {
+        E[0].set_resource(&pool);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_assign(void)
+{
+    const int table[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+
+    array<int, 3> A(2, 2, 3);
+    A.assign(table, table + 12);
+    cout << A << A.pos() << " " << A[1].pos() << endl;
+
+    array<double, 2> B(2, 3);
+    B.assign(table, table + 4);
+    B, 0.5, 0.25;
+    cout << B;
+
+    std::vector<float> v(table, table + 5);
+    array<float, 1> C(5);
+    C.assign(v.begin(), v.end());
+    cout << C << endl;
+
+    std::istringstream is("7 8 9");
+    buffer<int> D(2);
+    D.assign(std::istream_iterator<int>(is), std::istream_iterator<int>());
+    cout << D << endl;
+    D.assign(table, table + 5);
+    D.push(6);
+    cout << D << endl << D.occupied() << " " << D.head() << endl;
+
+#ifdef FRAMEWORK_CXX11
+    array<int, 1> E = { 3, 1, 4, 1, 5 };
+    B = { 9, 8, 7 };
+#else
+    array<int, 1> E(5);
+    E = 3, 1, 4, 1, 5;
+    B = 9, 8, 7;
+#endif
+    cout << E << endl << B;
+
+    try {
+        C.assign(table, table + 6);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_iterator(void)
+{
+    const int table[] = { 5, 3, 9, 1, 7, 2 };
+
+    array<int, 1> A(6);
+    A.assign(table, table + 6);
+    std::sort(A.begin(), A.end());
+    cout << A << endl;
+
+    array<double, 2> B(2, 3);
+    B.assign(table, table + 6);
+    const array<double, 2>& cB = B;
+    double t = 0;
+    for (array<double, 2>::const_iterator e = cB.begin(); e != cB.end(); ++e)
+        t += *e;
+    cout << t << " " << *std::max_element(B.begin(), B.end()) << endl;
+
+    // wrapped around, the oldest element is at physical index 2
+    buffer<int> C(5);
+    for (int i = 0; i < 7; ++i)
+        C.push(table[i % 6] * 10 + i);
+    cout << C << endl << C.head() << " " << (C.end() - C.begin()) << endl;
+    std::sort(C.begin(), C.end());
+    std::reverse_copy(C.begin(), C.end(), std::ostream_iterator<int>(cout, " "));
+    cout << endl;
+    buffer<int>::const_iterator it = std::lower_bound(C.begin(), C.end(), 50);
+    cout << *it << " " << (it - C.begin()) << " " << it[1] << " " << *(1 + it) << endl;
+
+#ifdef FRAMEWORK_CXX11
+    int total = 0;
+    for (int& e : C) total += e;
+    for (auto e : A) total += e;
+#else
+    int total = 0;
+    for (buffer<int>::iterator e = C.begin(); e != C.end(); ++e) total += *e;
+    for (array<int, 1>::iterator e = A.begin(); e != A.end(); ++e) total += *e;
+#endif
+    cout << total << endl;
+}
+
+void test_sparse(void)
+{
+    coo_array<double> coo(4, 5);
+    coo.insert(2, 3, 1.5);
+    coo.insert(0, 4, 2);
+    coo.insert(0, 1, -1);
+    coo.insert(3, 0, 4);
+    coo.insert(2, 3, 0.5);
+    sparse_array<double> A(coo);
+    cout << A << A.nonzeros() << " " << A.size(0) << "x" << A.size(1) << " "
+         << A(2, 3) << " " << A(1, 1) << endl;
+
+    array<double, 2> D(4, 5);
+    fill(D, 0);
+    D[0][1] = 3;
+    D[2][2] = 1;
+    D[2][3] = 2;
+    sparse_array<double> B(D);
+    cout << (A + B) << (A - B * 2.0) << hadamard(A, B);
+
+    array<double, 1> x(5), y;
+    x = 1, 2, 3, 4, 5;
+    gemv(1.0, A, x, 0.0, y);
+    cout << y << endl;
+
+    array<double, 2> X(5, 2), C, E;
+    X = 1, 0, 0, 1, 1, 1, 2, 0, 0, 2;
+    gemm(2.0, A, X, 0.0, C);
+    A.dense(E);
+    gemm(2.0, E, X, -1.0, C);
+    cout << C;
+
+    // a banded 2000 x 2000 product against the dense one
+    size_t n = 2000;
+    coo_array<float> band(n, n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = (i < 2) ? 0 : i - 2; j < std::min(n, i + 3); j++)
+            band.insert(i, j, (i + j) % 7);
+    sparse_array<float> S(band);
+    array<float, 2> SD;
+    S.dense(SD);
+    array<float, 1> v(n), w1, w2;
+    for (size_t i = 0; i < n; i++) v[i] = i % 5;
+    gemv(1.0f, S, v, 0.0f, w1);
+    gemv(1.0f, SD, v, 0.0f, w2, false);
+    float err = 0;
+    for (size_t i = 0; i < n; i++) err = std::max(err, std::abs(w1[i] - w2[i]));
+    cout << S.nonzeros() << " " << err << " " << sparse_array<float>(SD).nonzeros() << endl;
+
+    try {
+        coo.insert(4, 0, 1);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+    try {
+        A += sparse_array<double>(5, 4);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+struct spsc_run
+{
+    spsc_buffer<int>*       q;
+    spsc_buffer<int, true>* lossy;
+    int                     n;
+};
+
+void* spsc_produce(void* arg)
+{
+    spsc_run* r = static_cast<spsc_run*>(arg);
+    for (int i = 0; i < r->n; ) {
+        if (r->q) {
+            if (r->q->try_push(i)) ++i;
+        } else {
+            r->lossy->push(i++);
+        }
+    }
+    return NULL;
+}
+
+void test_spsc(void)
+{
+    spsc_buffer<int> A(3);
+    int v = 0;
+    for (int i = 0; i < 5; ++i)
+        cout << A.try_push(i);
+    cout << " " << A.capacity() << " " << A.occupied() << " ";
+    while (A.try_pop(v))
+        cout << v;
+    cout << " " << A.empty() << endl;
+
+    spsc_buffer<int, true> B(4);
+    for (int i = 0; i < 7; ++i)
+        B.push(i);
+    cout << B.try_push(7) << " ";
+    while (B.try_pop(v))
+        cout << v;
+    cout << endl;
+
+    // every element arrives once and in order
+    spsc_buffer<int> C(1024);
+    spsc_run r = { &C, NULL, 1000000 };
+    pthread_t t;
+    pthread_create(&t, NULL, spsc_produce, &r);
+    long long total = 0;
+    bool ordered = true;
+    for (int i = 0; i < r.n; ) {
+        if (C.try_pop(v)) {
+            ordered = ordered && (v == i++);
+            total += v;
+        }
+    }
+    pthread_join(t, NULL);
+    cout << ordered << " " << total << endl;
+
+    // with overwrite some are dropped, the rest still arrive in order
+    spsc_buffer<int, true> D(64);
+    spsc_run s = { NULL, &D, 1000000 };
+    pthread_create(&t, NULL, spsc_produce, &s);
+    int last = -1;
+    ordered = true;
+    for (;;) {
+        if (D.try_pop(v)) {
+            ordered = ordered && (v > last);
+            last = v;
+            if (v == s.n - 1) break;
+        }
+    }
+    pthread_join(t, NULL);
+    cout << ordered << " " << last << endl;
+}
+
+struct mpmc_run
+{
+    mpmc_queue<int>*    q;
+    int                 n;
+    long long           total;
+};
+
+void* mpmc_produce(void* arg)
+{
+    mpmc_run* r = static_cast<mpmc_run*>(arg);
+    for (int i = 1; i <= r->n; ++i)
+        r->q->push(i);
+    r->q->push(0);
+    return NULL;
+}
+
+void* mpmc_consume(void* arg)
+{
+    mpmc_run* r = static_cast<mpmc_run*>(arg);
+    int v;
+    for (r->q->pop(v); v; r->q->pop(v))
+        r->total += v;
+    return NULL;
+}
+
+// counts the elements which hold something
+struct mpmc_held
+{
+    static int  live;
+    int         n;
+
+    mpmc_held(int k = 0) : n(k) { if (n) ++live; }
+    mpmc_held(const mpmc_held& o) : n(o.n) { if (n) ++live; }
+    ~mpmc_held() { if (n) --live; }
+    mpmc_held& operator= (const mpmc_held& o)
+    {
+        if (n) --live;
+        n = o.n;
+        if (n) ++live;
+        return *this;
+    }
+};
+
+int mpmc_held::live = 0;
+
+void test_mpmc(void)
+{
+    mpmc_queue<int> A(3);
+    int v = 0;
+    for (int i = 0; i < 4; ++i)
+        cout << A.try_push(i);
+    cout << " " << A.capacity() << " " << A.occupied() << " " << A.push_for(9, 0.01) << " ";
+    while (A.try_pop(v))
+        cout << v;
+    cout << " " << A.pop_for(v, 0.01) << " " << A.empty() << endl;
+
+    // one slot can't tell a filled slot from a free one of the next lap
+    try {
+        mpmc_queue<int> one(1);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+
+    // 4 producers and 4 consumers through 5 slots, each consumer stops
+    // at the first 0 it takes
+    mpmc_queue<int> B(5);
+    mpmc_run runs[8];
+    pthread_t t[8];
+    for (int k = 0; k < 8; ++k) {
+        mpmc_run r = { &B, 100000, 0 };
+        runs[k] = r;
+        pthread_create(&t[k], NULL, (k < 4) ? mpmc_produce : mpmc_consume, &runs[k]);
+    }
+    long long total = 0;
+    for (int k = 0; k < 8; ++k) {
+        pthread_join(t[k], NULL);
+        total += runs[k].total;
+    }
+    cout << total << " " << B.empty() << endl;
+
+    // a popped element leaves nothing behind in its slot
+    mpmc_queue<mpmc_held> C(2);
+    {
+        mpmc_held h(1000), x;
+        C.try_push(h);
+        C.try_pop(x);
+        cout << x.n << " " << mpmc_held::live;
+    }
+    cout << " " << mpmc_held::live << endl;
+}
+
+void test_batch(void)
+{
+    const short frame[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+    buffer<short> A(8);
+    A.push(frame, 5);
+    A.push(frame + 5, 5);
+    cout << A << endl << A.occupied() << " " << A.head() << endl;
+
+    // the rest wraps around the end of the storage
+    float out[6];
+    size_t n = A.pop(out, 3);
+    buffer_span<short> r = A.peek();
+    cout << n << " " << out[0] << " " << out[2] << " "
+         << r.first_size << " " << r.second_size << " " << *r.second << endl;
+    n = A.pop(out, 6);
+    cout << n << " " << out[4] << " " << A.occupied() << endl;
+
+    // fill the free slots in place, across the wrap
+    buffer<short> B(4);
+    B.push(frame, 3);
+    B.consume(2);
+    buffer_span<short> w = B.prepare();
+    cout << w.first_size << " " << w.second_size << endl;
+    for (size_t i = 0; i < w.first_size; ++i) w.first[i] = 100 + i;
+    for (size_t i = 0; i < w.second_size; ++i) w.second[i] = 200 + i;
+    B.commit(w.size());
+    cout << B << endl << B.pop() << " " << B.occupied() << endl;
+
+    A.push(frame, 10);
+    cout << A << endl;
+
+    try {
+        A.commit(1);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_mirrored(void)
+{
+    mirrored_buffer<int> A(1000);
+    cout << A.size() << " " << (A.size() % mirrored_buffer<int>::granularity()) << endl;
+
+    array<int, 1> frame(300);
+    for (size_t i = 0; i < 300; ++i) frame[i] = i;
+    for (int k = 0; k < 5; ++k)
+        A.push(frame.data(), 300);
+
+    // the window runs across the seam in one piece
+    const int* w = A.window();
+    bool contiguous = true;
+    for (size_t i = 0; i < A.occupied(); ++i)
+        contiguous = contiguous && (w[i] == A.at(i)) && (w[i] == (int)((476 + i) % 300));
+    buffer_span<int> r = A.peek();
+    cout << A.head() << " " << A.occupied() << " " << contiguous << " "
+         << r.first_size << " " << r.second_size << " " << A.data()[5] << " "
+         << A.data()[A.size() + 5] << endl;
+
+    A.consume(1000);
+    buffer_span<int> f = A.prepare();
+    f.first[f.first_size - 1] = -7;
+    A.commit(f.first_size);
+    cout << f.first_size << " " << A[A.occupied() - 1] << " " << sum(A) << endl;
+
+    try {
+        A.set_resource(&heap_resource::global());
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+
+    // resize maps again
+    A.resize(1024);
+    for (int i = 0; i < 1500; ++i)
+        A.push(i);
+    cout << A.size() << " " << A[1000] << " " << A.window()[A.occupied() - 1] << endl;
+    try {
+        A.set_policy(GROW);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+}
+
+void test_stats(void)
+{
+    const int samples[] = { 5, 1, 4, 1, 5, 9, 2, 6, 5, 3 };
+
+    stats_buffer<int> A(4);
+    for (int i = 0; i < 10; ++i) {
+        A.push(samples[i]);
+        cout << A.min_value() << A.max_value() << " ";
+    }
+    cout << endl << sum(A) << " " << A.mean() << " " << A.variance() << " "
+         << A.quantile(0.5) << endl;
+    cout << A.pop() << " " << A.mean() << " " << min_value(A) << " " << max_value(A) << endl;
+
+    // against a pass over the window, and the histogram against selection
+    stats_buffer<double> B(1000);
+    B.set_histogram(0, 1, 100);
+    unsigned int seed = 12345;
+    double worst = 0, qerr = 0;
+    for (int i = 0; i < 20000; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        B.push((seed >> 8) / 16777216.0);
+        if (i % 997 == 0) {
+            double m = 0, v = 0;
+            for (size_t k = 0; k < B.occupied(); ++k) m += B[k];
+            m /= B.occupied();
+            for (size_t k = 0; k < B.occupied(); ++k) v += (B[k] - m) * (B[k] - m);
+            v /= B.occupied();
+            worst = std::max(worst, std::max(std::abs(m - B.mean()), std::abs(v - B.variance())));
+            stats_buffer<double> C(B.occupied());
+            for (size_t k = 0; k < B.occupied(); ++k) C.push(B[k]);
+            qerr = std::max(qerr, std::abs(B.quantile(0.9) - C.quantile(0.9)));
+        }
+    }
+    cout << (worst < 1e-12) << " " << (qerr < 0.01) << " "
+         << (B.min_value() == min_value(B.window())) << " "
+         << (B.max_value() == max_value(B.window())) << endl;
+
+    A.consume(3);
+    try {
+        A.min_value();
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+
+    // the candidates follow the new size
+    stats_buffer<double> D(4);
+    D.resize(8);
+    for (int i = 0; i < 10; ++i)
+        D.push(samples[i]);
+    cout << D.size() << " " << D.sum() << " " << D.min_value() << " " << D.max_value() << endl;
+
+    // the buffer is only changed through the statistics, so they agree
+    // with a pass over the window after any mix of calls
+    double out[3];
+    D.pop(out, 3);
+    D.push(samples, 4);
+    D.consume(2);
+    double m = D.mean(), v = D.variance();
+    D.refresh();
+    cout << (std::abs(m - D.mean()) < 1e-12) << (std::abs(v - D.variance()) < 1e-12)
+         << (D.min_value() == min_value(D.window())) << (D.max_value() == max_value(D.window()))
+         << " " << D.occupied() << " " << D[0] << endl;
+}
+
+struct shm_big
+{
+    int v[16384];
+};
+
+void test_shm(void)
+{
+    char name[64];
+    sprintf(name, "/framework-test-%d", static_cast<int>(getpid()));
+    shm_buffer<int>::unlink(name);
+
+    // a child process produces, this one consumes
+    const int n = 100000;
+    {
+        shm_buffer<int> A(name, 1000);
+        cout << A.capacity() << " " << A.generation() << endl;
+        pid_t pid = fork();
+        if (pid == 0) {
+            shm_buffer<int> P(name);
+            for (int i = 1; i <= n; ++i)
+                P.push(i);
+            _exit(0);
+        }
+        long long sum = 0;
+        int e, last = 0;
+        bool ordered = true;
+        for (int i = 0; i < n; ++i) {
+            A.pop(e);
+            ordered = ordered && (e == last + 1);
+            last = e;
+            sum += e;
+        }
+        waitpid(pid, NULL, 0);
+        cout << sum << " " << ordered << " " << A.pop_for(e, 0.01) << endl;
+    }
+
+    // the indices stay in the segment, a later process continues
+    {
+        shm_buffer<int> A(name);
+        for (int i = 0; i < 3; ++i)
+            A.push(i * 10);
+    }
+    {
+        shm_buffer<int> A(name);
+        int e;
+        cout << A.occupied() << ":";
+        while (A.try_pop(e))
+            cout << " " << e;
+        cout << " " << A.recover() << endl;
+    }
+
+    try {
+        shm_buffer<double> B(name);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+    shm_buffer<int>::unlink(name);
+
+    // several producer processes
+    {
+        shm_buffer<int> A(name, 64, shm_buffer<int>::MPSC);
+        pid_t pids[3];
+        for (int k = 0; k < 3; ++k) {
+            pids[k] = fork();
+            if (pids[k] == 0) {
+                shm_buffer<int> P(name, 0, shm_buffer<int>::MPSC);
+                for (int i = 1; i <= 10000; ++i)
+                    P.push(i);
+                _exit(0);
+            }
+        }
+        long long sum = 0;
+        int e;
+        for (int i = 0; i < 30000; ++i) {
+            A.pop(e);
+            sum += e;
+        }
+        for (int k = 0; k < 3; ++k)
+            waitpid(pids[k], NULL, 0);
+        cout << sum << " " << A.occupied() << endl;
+    }
+    shm_buffer<int>::unlink(name);
+
+    // a producer killed at an arbitrary point, mostly half way through
+    // copying an element in, doesn't keep the consumer from what a later
+    // one pushes
+    typedef shm_buffer<shm_big> big_buffer;
+    static shm_big e;
+    for (int m = big_buffer::SPSC; m <= big_buffer::MPSC; ++m) {
+        big_buffer::mode mode = static_cast<big_buffer::mode>(m);
+        big_buffer A(name, 64, mode);
+        for (int round = 0; round < 10; ++round) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                big_buffer P(name, 0, mode);
+                static shm_big x;
+                for (int i = 0; ; ++i) {
+                    x.v[0] = i;
+                    P.push(x);
+                }
+            }
+            usleep(200 + round * 150);
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            while (A.try_pop(e) || A.recover())
+                ;
+        }
+        {
+            big_buffer P(name, 0, mode);
+            e.v[0] = -1;
+            P.push(e);
+        }
+        e.v[0] = 0;
+        cout << (A.pop_for(e, 1.0) && (e.v[0] == -1));
+        shm_buffer<shm_big>::unlink(name);
+    }
+    cout << endl;
+}
+
+void test_policy(void)
+{
+    const int v[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+    // the default drops the oldest, now counted
+    buffer<int> A(3);
+    for (int i = 0; i < 5; ++i)
+        A.push(v[i]);
+    cout << A << " " << A.overwritten() << " " << A.dropped() << endl;
+
+    // growing keeps the order of wrapped contents
+    A.reserve(5);
+    cout << A << " " << A.size() << " " << A.head() << endl;
+    A.push(v, 6);
+    cout << A << " " << A.overwritten() << endl;
+
+    A.set_policy(REJECT);
+    A.reset_counters();
+    cout << A.push(11) << " " << A.push(v, 4) << " " << A.dropped() << endl;
+    A.consume(3);
+    cout << A.push(v, 4) << " " << A << " " << A.dropped() << endl;
+
+    // grows by doubling instead of dropping anything
+    buffer<int> B;
+    B.set_policy(GROW);
+    for (int i = 0; i < 10; ++i)
+        B.push(v[i]);
+    cout << B << " " << B.size() << endl;
+    B.pop(); B.pop(); B.pop();
+    B.push(v, 10);
+    cout << B.size() << " " << B.occupied() << " " << B[0] << " " << B[16] << " "
+         << B.overwritten() + B.dropped() << endl;
+
+    B.set_size(3);
+    cout << B.size() << " " << B.occupied() << endl;
+
+    // a copy keeps the policy and the counters, and so does a move out
+    // of mirrored storage, which has to copy
+    buffer<int> C(A);
+    mirrored_buffer<int> M(10);
+    M.set_policy(REJECT);
+    for (int i = 0; i < 2000; ++i)
+        M.push(i);
+#ifdef FRAMEWORK_CXX11
+    B = std::move(M);
+#else
+    B = M;
+#endif
+    cout << (C.policy() == REJECT) << " " << C.dropped() << " " << C << " "
+         << (B.policy() == REJECT) << " " << B.dropped() << " " << B[B.occupied() - 1] << endl;
+
+    // assign follows the policy alike from pointers, forward and input
+    // iterators
+    const full_policy policies[] = { OVERWRITE, REJECT, GROW };
+    std::vector<int> vec(v, v + 6);
+    for (int k = 0; k < 3; ++k) {
+        for (int from = 0; from < 3; ++from) {
+            buffer<int> D(4);
+            D.set_policy(policies[k]);
+            istringstream in("1 2 3 4 5 6");
+            if (from == 0)
+                D.assign(v, v + 6);
+            else if (from == 1)
+                D.assign(vec.begin(), vec.end());
+            else
+                D.assign(istream_iterator<int>(in), istream_iterator<int>());
+            cout << D << " " << D.size() << " " << D.overwritten() << " " << D.dropped() << "  ";
+        }
+        cout << endl;
+    }
+
+#ifdef FRAMEWORK_CXX11
+    // a row can't take another shape, the move throws like a copy would
+    array<int, 2> G(3, 4);
+    array<int, 1> H(7);
+    try {
+        G[0] = std::move(H);
+    } catch (array_exception e) {
+        SHOW(e);
+    }
+#endif
+}
+
+// keeps what it gets, slowly
+struct slow_sink : public streambuf
+{
+    ostringstream   s;
+    int             writes;
+    pthread_mutex_t m;
+
+    slow_sink() : writes(0) { pthread_mutex_init(&m, NULL); }
+    ~slow_sink() { pthread_mutex_destroy(&m); }
+
+    virtual streamsize xsputn(const char* p, streamsize n)
+    {
+        usleep(20000);
+        scoped_lock_ lk(&m);
+        writes++;
+        s.write(p, n);
+        return n;
+    }
+
+    string str(void)
+    {
+        scoped_lock_ lk(&m);
+        return s.str();
+    }
+};
+
+void test_async_log(void)
+{
+    char name[64];
+    sprintf(name, "/tmp/framework-log-%d.txt", static_cast<int>(getpid()));
+
+    // a writer thread takes the lines, close() waits for all of them
+    {
+        logstream log(name);
+        log.cout_off();
+        log.async(4);
+        for (int i = 0; i < 20000; ++i)
+            log << "line " << i << endl;
+        log.printf("%s\n", "last");
+        log.close();
+        cout << log.dropped() << endl;
+    }
+    {
+        ifstream in(name);
+        string line, prev;
+        int n = 0;
+        while (getline(in, line)) {
+            prev = line;
+            n++;
+        }
+        cout << n << " " << prev << endl;
+    }
+
+    // with one block, what's written while the writer holds it is
+    // dropped, everything else gets out
+    {
+        logstream log(name);
+        log.cout_off();
+        log.async(1, LOG_DROP);
+        for (int i = 0; i < 1000; ++i)
+            log << "line " << i << endl;
+        log << "end\n";
+        log.close();
+        ifstream in(name);
+        in.seekg(0, ios::end);
+        cout << (static_cast<long>(in.tellg()) + log.dropped()) << endl;
+    }
+    remove(name);
+
+    // while the writer is busy on a slow sink the lines gather in one
+    // block instead of taking one each
+    {
+        slow_sink slow;
+        logstreambuf buf(&slow, &slow);
+        buf.sbuf2_off();
+        ostream os(&buf);
+        buf.async_on(4);
+        for (int i = 0; i < 200; ++i)
+            os << "line " << i << endl;
+        buf.async_off();
+        cout << slow.str().size() << " " << (slow.writes < 10) << endl;
+    }
+
+    // a line flushed while the writer is busy goes out once it's done,
+    // not with the next one
+    {
+        slow_sink slow;
+        logstreambuf buf(&slow, &slow);
+        buf.sbuf2_off();
+        ostream os(&buf);
+        buf.async_on(4);
+        os << "first" << endl;
+        os << "second" << endl;
+        usleep(300000);
+        cout << slow.str();
+        buf.async_off();
+    }
+}
+
+struct mt_log_run
+{
+    mt_logstream*   log;
+    int             id;
+};
+
+void* mt_log_write(void* arg)
+{
+    mt_log_run* r = static_cast<mt_log_run*>(arg);
+    for (int i = 0; i < 2000; ++i) {
+        *r->log << "thread " << r->id << " line " << i;
+        for (int k = 0; k < 8; ++k)
+            *r->log << " " << r->id * 100 + k;
+        *r->log << endl;
+    }
+    r->log->printf("thread %d done\n", r->id);
+    return NULL;
+}
+
+// lines per thread which came out whole and in order, -1 if any didn't
+void mt_log_check(const char* name, int* lines, int threads)
+{
+    for (int k = 0; k < threads; ++k)
+        lines[k] = 0;
+    ifstream in(name);
+    string line;
+    while (getline(in, line)) {
+        istringstream is(line);
+        string w1, w2;
+        int id, i;
+        is >> w1 >> id >> w2;
+        if ((w1 != "thread") || (id < 0) || (id >= threads) || (lines[id] < 0))
+            continue;
+        if (w2 == "done") {
+            lines[id] = (lines[id] == 2000) ? lines[id] + 1 : -1;
+            continue;
+        }
+        bool ok = (w2 == "line") && (is >> i) && (i == lines[id]);
+        for (int k = 0; ok && (k < 8); ++k) {
+            int v;
+            ok = (is >> v) && (v == id * 100 + k);
+        }
+        lines[id] = ok ? lines[id] + 1 : -1;
+    }
+}
+
+// writes a record without a flush and stays until the process exits
+void* mt_log_linger(void* arg)
+{
+    mt_log_run* r = static_cast<mt_log_run*>(arg);
+    *r->log << "other " << r->id << "\n";
+    __atomic_store_n(&r->id, -1, __ATOMIC_RELEASE);
+    for (;;)
+        pause();
+    return NULL;
+}
+
+void test_mt_log(void)
+{
+    char name[64];
+    sprintf(name, "/tmp/framework-mtlog-%d.txt", static_cast<int>(getpid()));
+    int lines[4];
+
+    for (int mode = 0; mode < 2; ++mode) {
+        {
+            mt_logstream log(name);
+            log.cout_off();
+            if (mode) log.async(8);
+            mt_log_run runs[4];
+            pthread_t t[4];
+            for (int k = 0; k < 4; ++k) {
+                runs[k].log = &log;
+                runs[k].id  = k;
+                pthread_create(&t[k], NULL, mt_log_write, &runs[k]);
+            }
+            for (int k = 0; k < 4; ++k)
+                pthread_join(t[k], NULL);
+            log << "pending" << 1;
+        }
+        mt_log_check(name, lines, 4);
+        for (int k = 0; k < 4; ++k)
+            cout << lines[k] << " ";
+        ifstream in(name);
+        string line, last;
+        while (getline(in, line))
+            last = line;
+        cout << last << endl;
+    }
+
+    // exit() commits the records of every thread, in either mode
+    for (int mode = 0; mode < 2; ++mode) {
+        pid_t pid = fork();
+        if (!pid) {
+            // never destroyed, only the exit hook writes it out
+            mt_logstream* log = new mt_logstream(name);
+            log->cout_off();
+            if (mode) log->async(8);
+            mt_log_run r = { log, mode };
+            pthread_t t;
+            pthread_create(&t, NULL, mt_log_linger, &r);
+            while (__atomic_load_n(&r.id, __ATOMIC_ACQUIRE) != -1)
+                usleep(1000);
+            exit(0);
+        }
+        waitpid(pid, NULL, 0);
+        ifstream in(name);
+        string line;
+        while (getline(in, line))
+            cout << line << " ";
+        cout << endl;
+    }
+
+    // the last line out of a burst gets out without another one, and
+    // the blocks the thread held come back
+    {
+        mt_logstream log(name);
+        log.cout_off();
+        log.async(2);
+        for (int i = 0; i < 2000; ++i)
+            log << "line " << i << endl;
+        log << "last" << endl;
+        usleep(300000);
+        ifstream in(name);
+        string line, prev;
+        while (getline(in, line))
+            prev = line;
+        log.async_off();
+        cout << prev << " " << log.dropped() << endl;
+    }
+    remove(name);
+}